@@ -10,6 +10,35 @@
  */
 
 #include <math.h>
+#include <stddef.h>
+
+//SIMD detection, define MMATH_NO_SIMD to force scalar code
+#if !defined(MMATH_NO_SIMD)
+	#if defined(__AVX__)
+	#define MMATH_AVX
+	#endif
+	#if defined(__AVX__) && defined(MMATH_DOUBLE)
+	#define MMATH_AVX_DOUBLE
+	#endif
+	#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define MMATH_SSE
+	#endif
+	#if defined(MMATH_AVX) || defined(MMATH_SSE)
+	#include <immintrin.h>
+	#endif
+#endif
+
+//Atomics on long, sequentially consistent
+#if defined(_MSC_VER) && !defined(__clang__)
+	#include <intrin.h>
+	#define mm_atomic_load(p)     (_InterlockedOr((volatile long*)(p), 0))
+	#define mm_atomic_store(p, v) ((void)_InterlockedExchange((volatile long*)(p), (v)))
+	#define mm_atomic_add(p, v)   (_InterlockedExchangeAdd((volatile long*)(p), (v)))
+#else
+	#define mm_atomic_load(p)     (__atomic_load_n((p), __ATOMIC_SEQ_CST))
+	#define mm_atomic_store(p, v) (__atomic_store_n((p), (v), __ATOMIC_SEQ_CST))
+	#define mm_atomic_add(p, v)   (__atomic_fetch_add((p), (v), __ATOMIC_SEQ_CST))
+#endif
 
 #if defined(__cplusplus)
 extern "C" {
@@ -116,6 +145,7 @@ extern "C" {
 	#define mm_acos(var) (acos(var))
 	#define mm_asin(var) (asin(var))
 	#define mm_atan(var) (atan(var))
+	#define mm_atan2(y, x) (atan2(y, x))
 	#define mm_cos(var)  (cos(var))
 	#define mm_sin(var)  (sin(var))
 	#define mm_tan(var)  (tan(var))
@@ -127,6 +157,7 @@ extern "C" {
 	#define mm_acos(var) (acosf(var))
 	#define mm_asin(var) (asinf(var))
 	#define mm_atan(var) (atanf(var))
+	#define mm_atan2(y, x) (atan2f(y, x))
 	#define mm_cos(var)  (cosf(var))
 	#define mm_sin(var)  (sinf(var))
 	#define mm_tan(var)  (tanf(var))
@@ -140,6 +171,123 @@ extern "C" {
 	#define mm_pi  ((scalar)3.141592653589793) //pi
 	#define mm_hpi ((scalar)1.570796326794896) //half pi
 
+	//SIMD packets
+	//mm_packet holds MMATH_PACKET_WIDTH scalars, mm_mask is the result of a comparison.
+	//mmp_and/mmp_or/mmp_select only take masks, mmp_movemask packs a mask into lane bits.
+	#if defined(MMATH_AVX) && !defined(MMATH_DOUBLE)
+	#define MMATH_PACKET_WIDTH 8
+	typedef __m256 mm_packet;
+	typedef __m256 mm_mask;
+	#define mmp_set1(a)         (_mm256_set1_ps(a))
+	#define mmp_load(p)         (_mm256_loadu_ps(p))
+	#define mmp_store(p, a)     (_mm256_storeu_ps(p, a))
+	#define mmp_add(a, b)       (_mm256_add_ps(a, b))
+	#define mmp_sub(a, b)       (_mm256_sub_ps(a, b))
+	#define mmp_mul(a, b)       (_mm256_mul_ps(a, b))
+	#define mmp_div(a, b)       (_mm256_div_ps(a, b))
+	#define mmp_min(a, b)       (_mm256_min_ps(a, b))
+	#define mmp_max(a, b)       (_mm256_max_ps(a, b))
+	#define mmp_sqrt(a)         (_mm256_sqrt_ps(a))
+	#define mmp_lt(a, b)        (_mm256_cmp_ps(a, b, _CMP_LT_OQ))
+	#define mmp_le(a, b)        (_mm256_cmp_ps(a, b, _CMP_LE_OQ))
+	#define mmp_and(a, b)       (_mm256_and_ps(a, b))
+	#define mmp_or(a, b)        (_mm256_or_ps(a, b))
+	#define mmp_select(m, a, b) (_mm256_blendv_ps(b, a, m))
+	#define mmp_movemask(m)     (_mm256_movemask_ps(m))
+	#define mmp_rsqrt_estimate(a) (_mm256_rsqrt_ps(a))
+	#define MMATH_RSQRT_STEPS 1
+	#elif defined(MMATH_AVX_DOUBLE)
+	#define MMATH_PACKET_WIDTH 4
+	typedef __m256d mm_packet;
+	typedef __m256d mm_mask;
+	#define mmp_set1(a)         (_mm256_set1_pd(a))
+	#define mmp_load(p)         (_mm256_loadu_pd(p))
+	#define mmp_store(p, a)     (_mm256_storeu_pd(p, a))
+	#define mmp_add(a, b)       (_mm256_add_pd(a, b))
+	#define mmp_sub(a, b)       (_mm256_sub_pd(a, b))
+	#define mmp_mul(a, b)       (_mm256_mul_pd(a, b))
+	#define mmp_div(a, b)       (_mm256_div_pd(a, b))
+	#define mmp_min(a, b)       (_mm256_min_pd(a, b))
+	#define mmp_max(a, b)       (_mm256_max_pd(a, b))
+	#define mmp_sqrt(a)         (_mm256_sqrt_pd(a))
+	#define mmp_lt(a, b)        (_mm256_cmp_pd(a, b, _CMP_LT_OQ))
+	#define mmp_le(a, b)        (_mm256_cmp_pd(a, b, _CMP_LE_OQ))
+	#define mmp_and(a, b)       (_mm256_and_pd(a, b))
+	#define mmp_or(a, b)        (_mm256_or_pd(a, b))
+	#define mmp_select(m, a, b) (_mm256_blendv_pd(b, a, m))
+	#define mmp_movemask(m)     (_mm256_movemask_pd(m))
+	//no double estimate instruction and a float one would limit the range, so divide
+	#define mmp_rsqrt_estimate(a) (_mm256_div_pd(_mm256_set1_pd(1), _mm256_sqrt_pd(a)))
+	#define MMATH_RSQRT_STEPS 0
+	#elif defined(MMATH_SSE) && !defined(MMATH_DOUBLE)
+	#define MMATH_PACKET_WIDTH 4
+	typedef __m128 mm_packet;
+	typedef __m128 mm_mask;
+	#define mmp_set1(a)         (_mm_set1_ps(a))
+	#define mmp_load(p)         (_mm_loadu_ps(p))
+	#define mmp_store(p, a)     (_mm_storeu_ps(p, a))
+	#define mmp_add(a, b)       (_mm_add_ps(a, b))
+	#define mmp_sub(a, b)       (_mm_sub_ps(a, b))
+	#define mmp_mul(a, b)       (_mm_mul_ps(a, b))
+	#define mmp_div(a, b)       (_mm_div_ps(a, b))
+	#define mmp_min(a, b)       (_mm_min_ps(a, b))
+	#define mmp_max(a, b)       (_mm_max_ps(a, b))
+	#define mmp_sqrt(a)         (_mm_sqrt_ps(a))
+	#define mmp_lt(a, b)        (_mm_cmplt_ps(a, b))
+	#define mmp_le(a, b)        (_mm_cmple_ps(a, b))
+	#define mmp_and(a, b)       (_mm_and_ps(a, b))
+	#define mmp_or(a, b)        (_mm_or_ps(a, b))
+	#define mmp_select(m, a, b) (_mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)))
+	#define mmp_movemask(m)     (_mm_movemask_ps(m))
+	#define mmp_rsqrt_estimate(a) (_mm_rsqrt_ps(a))
+	#define MMATH_RSQRT_STEPS 1
+	#else
+	#define MMATH_PACKET_WIDTH 1
+	typedef scalar mm_packet;
+	typedef int mm_mask;
+	#define mmp_set1(a)         ((scalar)(a))
+	#define mmp_load(p)         (*(p))
+	#define mmp_store(p, a)     (*(p) = (a))
+	#define mmp_add(a, b)       ((a) + (b))
+	#define mmp_sub(a, b)       ((a) - (b))
+	#define mmp_mul(a, b)       ((a) * (b))
+	#define mmp_div(a, b)       ((a) / (b))
+	#define mmp_min(a, b)       ((a) < (b) ? (a) : (b))
+	#define mmp_max(a, b)       ((a) > (b) ? (a) : (b))
+	#define mmp_sqrt(a)         (mm_sqrt(a))
+	#define mmp_lt(a, b)        ((a) < (b))
+	#define mmp_le(a, b)        ((a) <= (b))
+	#define mmp_and(a, b)       ((a) && (b))
+	#define mmp_or(a, b)        ((a) || (b))
+	#define mmp_select(m, a, b) ((m) ? (a) : (b))
+	#define mmp_movemask(m)     ((m) != 0)
+	#define mmp_rsqrt_estimate(a) ((scalar)1.0 / mm_sqrt(a))
+	#define MMATH_RSQRT_STEPS 0
+	#endif
+	//fast reciprocal square root, the hardware estimate is refined with Newton-Raphson steps
+	MMATH_INLINE mm_packet mmp_rsqrt(mm_packet a) {
+		mm_packet y = mmp_rsqrt_estimate(a);
+		for (int i = 0; i < MMATH_RSQRT_STEPS; i++) {
+			y = mmp_mul(y, mmp_sub(mmp_set1(1.5), mmp_mul(mmp_mul(mmp_set1(0.5), a), mmp_mul(y, y))));
+		}
+		return y;
+	}
+	//strided access for AoS arrays, lanes past n repeat the first element
+	MMATH_INLINE mm_packet mmp_gather(const scalar *p, int stride, int n) {
+		scalar buf[MMATH_PACKET_WIDTH];
+		for (int l = 0; l < MMATH_PACKET_WIDTH; l++) {
+			buf[l] = p[(l < n ? l : 0) * stride];
+		}
+		return mmp_load(buf);
+	}
+	MMATH_INLINE void mmp_scatter(scalar *p, int stride, mm_packet a, int n) {
+		scalar buf[MMATH_PACKET_WIDTH];
+		mmp_store(buf, a);
+		for (int l = 0; l < n; l++) {
+			p[l * stride] = buf[l];
+		}
+	}
+
 	//Functions
 	MMATH_INLINE scalar radians(scalar degrees) {
 		return degrees * (scalar)0.0174532925199432; //PI / 180
@@ -322,7 +470,53 @@ extern "C" {
 		return dest;
 	}
 	
+	#if defined(MMATH_AVX_DOUBLE)
+	//a vec4 of doubles fills one AVX register
+	#if defined(__FMA__)
+	#define mmd_fmadd(a, b, c) (_mm256_fmadd_pd(a, b, c))
+	#else
+	#define mmd_fmadd(a, b, c) (_mm256_add_pd(_mm256_mul_pd(a, b), c))
+	#endif
+	#define MMATH_GENFUNC_VEC4D_SCALAR(name, op) \
+	MMATH_INLINE vec4* vec4##name(vec4 *dest, const vec4 *a, scalar b) { \
+		_mm256_storeu_pd(dest->data, op(_mm256_loadu_pd(a->data), _mm256_set1_pd(b))); \
+		return dest; \
+	}
+	#define MMATH_GENFUNC_VEC4D(name, op) \
+	MMATH_INLINE vec4* vec4##name(vec4 *dest, const vec4 *a, const vec4 *b) { \
+		_mm256_storeu_pd(dest->data, op(_mm256_loadu_pd(a->data), _mm256_loadu_pd(b->data))); \
+		return dest; \
+	}
+	MMATH_GENFUNC_VEC4D_SCALAR(AddScalar, _mm256_add_pd)
+	MMATH_GENFUNC_VEC4D_SCALAR(SubScalar, _mm256_sub_pd)
+	MMATH_GENFUNC_VEC4D_SCALAR(MulScalar, _mm256_mul_pd)
+	MMATH_GENFUNC_VEC4D_SCALAR(DivScalar, _mm256_div_pd)
+	MMATH_GENFUNC_VEC4D(Add, _mm256_add_pd)
+	MMATH_GENFUNC_VEC4D(Sub, _mm256_sub_pd)
+	MMATH_GENFUNC_VEC4D(Mul, _mm256_mul_pd)
+	MMATH_GENFUNC_VEC4D(Div, _mm256_div_pd)
+	MMATH_INLINE scalar vec4Dot(const vec4 *a, const vec4 *b) {
+		__m256d m = _mm256_mul_pd(_mm256_loadu_pd(a->data), _mm256_loadu_pd(b->data));
+		__m128d s = _mm_add_pd(_mm256_castpd256_pd128(m), _mm256_extractf128_pd(m, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+	}
+	MMATH_INLINE scalar vec4Length(const vec4 *a) {
+		return mm_sqrt(vec4Dot(a, a));
+	}
+	MMATH_INLINE vec4* vec4Negate(vec4 *dest, const vec4 *a) {
+		_mm256_storeu_pd(dest->data, _mm256_xor_pd(_mm256_loadu_pd(a->data), _mm256_set1_pd(-0.0)));
+		return dest;
+	}
+	MMATH_INLINE vec4* vec4Abs(vec4 *dest, const vec4 *a) {
+		_mm256_storeu_pd(dest->data, _mm256_andnot_pd(_mm256_set1_pd(-0.0), _mm256_loadu_pd(a->data)));
+		return dest;
+	}
+	MMATH_GENFUNC_VECDIST(4)
+	MMATH_GENFUNC_VECNORM(4)
+	MMATH_GENFUNC_VECLERP(4)
+	#else
 	MMATH_GENFUNC_VECSTANDARD(4)
+	#endif
 	MMATH_CONST vec4 vec4Zero     = { 0, 0, 0, 0 };
 	MMATH_CONST vec4 vec4Identity = { 1, 1, 1, 1 };
 	MMATH_INLINE vec2* vec4ToVec2(vec2 *dest, const vec4 *a) {
@@ -366,13 +560,35 @@ extern "C" {
 		return dest;
 	}
 	MMATH_INLINE quat* quatMul(quat *dest, const quat *a, const quat *b) {
-		dest->w = a->w * b->w - vec3Dot(&a->axis, &b->axis);
+	#if defined(MMATH_AVX_DOUBLE)
+		//sum of a's components times sign flipped shuffles of b
+		__m256d bv = _mm256_loadu_pd(b->data);
+		__m256d bh = _mm256_permute2f128_pd(bv, bv, 1); //z w x y
+		__m256d bp = _mm256_permute_pd(bv, 5);          //y x w z
+		__m256d br = _mm256_permute_pd(bh, 5);          //w z y x
+		__m256d r = _mm256_mul_pd(_mm256_set1_pd(a->w), bv);
+		r = mmd_fmadd(_mm256_set1_pd(a->x), _mm256_mul_pd(br, _mm256_setr_pd(1, -1, 1, -1)), r);
+		r = mmd_fmadd(_mm256_set1_pd(a->y), _mm256_mul_pd(bh, _mm256_setr_pd(1, 1, -1, -1)), r);
+		r = mmd_fmadd(_mm256_set1_pd(a->z), _mm256_mul_pd(bp, _mm256_setr_pd(-1, 1, 1, -1)), r);
+		_mm256_storeu_pd(dest->data, r);
+		return dest;
+	#else
+		quat ret;
+		ret.w = a->w * b->w - vec3Dot(&a->axis, &b->axis);
 		
 		vec3 BwAv, AwBv, abv, AxB;
 		vec3Add(&abv, vec3MulScalar(&BwAv, &a->axis, b->w),
 					  vec3MulScalar(&AwBv, &b->axis, a->w));
 
-		vec3Add(&dest->axis, &abv, vec3Cross(&AxB, &a->axis, &b->axis));
+		vec3Add(&ret.axis, &abv, vec3Cross(&AxB, &a->axis, &b->axis));
+		*dest = ret;
+		return dest;
+	#endif
+	}
+	MMATH_INLINE quat* quatMulBatch(quat *dest, const quat *a, const quat *b, int count) {
+		for (int i = 0; i < count; i++) {
+			quatMul(&dest[i], &a[i], &b[i]);
+		}
 		return dest;
 	}
 	MMATH_INLINE vec3* quatMulVec3(vec3 *dest, const quat *a, const vec3 *b) {
@@ -497,15 +713,49 @@ extern "C" {
 		
 		return dest;
 	}
+	//slerp without the shortest path flip, used by squad
+	MMATH_INLINE quat* quatSlerpDirect(quat *dest, const quat *f, const quat *l, scalar t) {
+		scalar dot = vec4Dot(&f->vec, &l->vec);
+		if (dot < (scalar)0.95) {
+			scalar angle = mm_acos(dot);
+			scalar s = (scalar)1.0 / mm_sin(angle);
+			scalar a = mm_sin(angle * (1 - t)) * s;
+			scalar b = mm_sin(angle * t) * s;
+			VEC_FOR(4) {
+				dest->data[i] = f->data[i] * a + l->data[i] * b;
+			}
+		} else {
+			vec4Lerp(&dest->vec, &f->vec, &l->vec, t);
+			quatNormalize(dest, dest);
+		}
+		return dest;
+	}
+	//log and exp of unit quaternions
+	MMATH_INLINE quat* quatLog(quat *dest, const quat *a) {
+		scalar len = vec3Length(&a->axis);
+		scalar s = len > (scalar)0.000001 ? mm_atan2(len, a->w) / len : 1;
+		vec3MulScalar(&dest->axis, &a->axis, s);
+		dest->w = 0;
+		return dest;
+	}
+	MMATH_INLINE quat* quatExp(quat *dest, const quat *a) {
+		scalar angle = vec3Length(&a->axis);
+		scalar s = angle > (scalar)0.000001 ? mm_sin(angle) / angle : 1;
+		vec3MulScalar(&dest->axis, &a->axis, s);
+		dest->w = mm_cos(angle);
+		return dest;
+	}
 	
 	//Matrix Math
 	#define MAT_FOR_FLAT(integer) for (int i = 0; i < integer * integer; i++)
 	#define MAT_FOR(integer) for (int x = 0; x < integer; x++) for (int y = 0; y < integer; y++)
 	#define MMATH_GENFUNC_MATTRPOSE(integer) \
 	MMATH_INLINE mat##integer* mat##integer##Transpose(mat##integer * dest, const mat##integer *a) { \
+		mat##integer ret; \
 		MAT_FOR(integer) { \
-			dest->row[x].data[y] = a->row[y].data[x]; \
+			ret.row[x].data[y] = a->row[y].data[x]; \
 		} \
+		*dest = ret; \
 		return dest; \
 	}
 	#define MMATH_GENFUNC_MATDIAG(integer) \
@@ -532,12 +782,13 @@ extern "C" {
 	}
 	#define MMATH_GENFUNC_MATMUL(integer) \
 	MMATH_INLINE mat##integer* mat##integer##Mul(mat##integer *dest, const mat##integer *a, const mat##integer *b) { \
-		*dest = (mat##integer){0}; \
+		mat##integer ret = {0}; \
 		MAT_FOR(integer) { \
 			VEC_FOR(integer) { \
-				dest->row[x].data[y] += a->row[x].data[i] * b->row[i].data[y]; \
+				ret.row[x].data[y] += a->row[x].data[i] * b->row[i].data[y]; \
 			} \
 		} \
+		*dest = ret; \
 		return dest; \
 	}
 	#define MMATH_GENFUNC_MATMULSCALAR(integer) \
@@ -549,12 +800,13 @@ extern "C" {
 	}
 	#define MMATH_GENFUNC_MATMULVEC(integer) \
 	MMATH_INLINE vec##integer* mat##integer##MulVec##integer(vec##integer *dest, const mat##integer *a, const vec##integer *b) { \
-		*dest = (vec##integer){0}; \
+		vec##integer ret = {0}; \
 		VEC_FOR(integer) { \
 			for (int c = 0; c < integer; c++) { \
-				dest->data[i] += a->row[c].data[i] * b->data[c]; \
+				ret.data[i] += a->row[c].data[i] * b->data[c]; \
 			} \
 		} \
+		*dest = ret; \
 		return dest; \
 	}
 	#define MMATH_GENFUNC_MATSTANDARD(integer) \
@@ -615,9 +867,199 @@ extern "C" {
 		*dest = ret;
 		return dest;
 	}
-	//MMATH_INLINE void mat3Inverse(mat3 *dest, const mat3 *a) {
-	//	mat3 ret; TODO: also make this
-	//}
+	MMATH_INLINE scalar mat3Determinant(const mat3 *a) {
+		vec3 c;
+		return vec3Dot(&a->r0, vec3Cross(&c, &a->r1, &a->r2));
+	}
+	//leaves dest untouched if a is singular
+	MMATH_INLINE mat3* mat3Inverse(mat3 *dest, const mat3 *a) {
+		mat3 cof;
+		vec3Cross(&cof.r0, &a->r1, &a->r2);
+		vec3Cross(&cof.r1, &a->r2, &a->r0);
+		vec3Cross(&cof.r2, &a->r0, &a->r1);
+		scalar det = vec3Dot(&a->r0, &cof.r0);
+		if (det == 0) {
+			return dest;
+		}
+		mat3Transpose(dest, &cof);
+		mat3MulScalar(dest, dest, (scalar)1.0 / det);
+		return dest;
+	}
+	//Shepperd's method, a must be a rotation
+	MMATH_INLINE quat* mat3ToQuat(quat *dest, const mat3 *a) {
+		scalar tr = a->x0 + a->y1 + a->z2;
+		if (tr >= a->x0 && tr >= a->y1 && tr >= a->z2) {
+			scalar s = (scalar)0.5 / mm_sqrt(1 + tr);
+			dest->x = (a->z1 - a->y2) * s;
+			dest->y = (a->x2 - a->z0) * s;
+			dest->z = (a->y0 - a->x1) * s;
+			dest->w = (1 + tr) * s;
+		} else if (a->x0 >= a->y1 && a->x0 >= a->z2) {
+			scalar t = 1 + a->x0 - a->y1 - a->z2;
+			scalar s = (scalar)0.5 / mm_sqrt(t);
+			dest->x = t * s;
+			dest->y = (a->y0 + a->x1) * s;
+			dest->z = (a->x2 + a->z0) * s;
+			dest->w = (a->z1 - a->y2) * s;
+		} else if (a->y1 >= a->z2) {
+			scalar t = 1 - a->x0 + a->y1 - a->z2;
+			scalar s = (scalar)0.5 / mm_sqrt(t);
+			dest->x = (a->y0 + a->x1) * s;
+			dest->y = t * s;
+			dest->z = (a->z1 + a->y2) * s;
+			dest->w = (a->x2 - a->z0) * s;
+		} else {
+			scalar t = 1 - a->x0 - a->y1 + a->z2;
+			scalar s = (scalar)0.5 / mm_sqrt(t);
+			dest->x = (a->x2 + a->z0) * s;
+			dest->y = (a->z1 + a->y2) * s;
+			dest->z = t * s;
+			dest->w = (a->y0 - a->x1) * s;
+		}
+		return dest;
+	}
+	//Polar decomposition a = rot * stretch by scaled Newton iteration, stretch may be NULL
+	#define MMATH_POLAR_ITERATIONS 16
+	#define MMATH_POLAR_EPSILON ((scalar)0.000001)
+	MMATH_INLINE mat3* mat3Polar(mat3 *rot, mat3 *stretch, const mat3 *a) {
+		mat3 q = *a;
+		for (int k = 0; k < MMATH_POLAR_ITERATIONS; k++) {
+			mat3 cof;
+			vec3Cross(&cof.r0, &q.r1, &q.r2);
+			vec3Cross(&cof.r1, &q.r2, &q.r0);
+			vec3Cross(&cof.r2, &q.r0, &q.r1);
+			scalar det = vec3Dot(&q.r0, &cof.r0);
+			if (det == 0) {
+				break;
+			}
+			//Frobenius norm scaling, q^-T = cof / det
+			scalar nq = 0, nc = 0;
+			MAT_FOR_FLAT(3) {
+				nq += q.data[i] * q.data[i];
+				nc += cof.data[i] * cof.data[i];
+			}
+			scalar g = mm_sqrt(mm_sqrt(nc / nq) / mm_abs(det));
+			scalar gq = (scalar)0.5 * g, gc = (scalar)0.5 / (g * det);
+			scalar diff = 0;
+			MAT_FOR_FLAT(3) {
+				scalar next = q.data[i] * gq + cof.data[i] * gc;
+				diff += mm_abs(next - q.data[i]);
+				q.data[i] = next;
+			}
+			if (diff < MMATH_POLAR_EPSILON) {
+				break;
+			}
+		}
+		if (stretch) {
+			mat3 qt;
+			mat3Mul(stretch, mat3Transpose(&qt, &q), a);
+		}
+		*rot = q;
+		return rot;
+	}
+
+	//Packet versions work on SoA 3x3 matrices, m[row * 3 + col]
+	MMATH_INLINE void mat3PacketToQuat(mm_packet q[4], const mm_packet m[9]) {
+		mm_packet one = mmp_set1(1);
+		mm_packet t0 = mmp_add(mmp_add(one, m[0]), mmp_add(m[4], m[8]));
+		mm_packet t1 = mmp_sub(mmp_add(one, m[0]), mmp_add(m[4], m[8]));
+		mm_packet t2 = mmp_sub(mmp_add(one, m[4]), mmp_add(m[0], m[8]));
+		mm_packet t3 = mmp_sub(mmp_add(one, m[8]), mmp_add(m[0], m[4]));
+		mm_packet a = mmp_sub(m[5], m[7]);
+		mm_packet b = mmp_sub(m[6], m[2]);
+		mm_packet c = mmp_sub(m[1], m[3]);
+		mm_packet d = mmp_add(m[1], m[3]);
+		mm_packet e = mmp_add(m[6], m[2]);
+		mm_packet f = mmp_add(m[5], m[7]);
+
+		//pick the largest of w, x, y, z without branching
+		mm_mask mw = mmp_and(mmp_le(t1, t0), mmp_and(mmp_le(t2, t0), mmp_le(t3, t0)));
+		mm_mask mx = mmp_and(mmp_le(t2, t1), mmp_le(t3, t1));
+		mm_mask my = mmp_le(t3, t2);
+		mm_packet big = mmp_select(mw, t0, mmp_select(mx, t1, mmp_select(my, t2, t3)));
+		mm_packet s = mmp_div(mmp_set1(0.5), mmp_sqrt(big));
+		q[0] = mmp_mul(mmp_select(mw, a, mmp_select(mx, t1, mmp_select(my, d, e))), s);
+		q[1] = mmp_mul(mmp_select(mw, b, mmp_select(mx, d, mmp_select(my, t2, f))), s);
+		q[2] = mmp_mul(mmp_select(mw, c, mmp_select(mx, e, mmp_select(my, f, t3))), s);
+		q[3] = mmp_mul(mmp_select(mw, t0, mmp_select(mx, a, mmp_select(my, b, c))), s);
+	}
+	MMATH_INLINE void mat3PacketPolar(mm_packet q[9], mm_packet stretch[9], const mm_packet m[9]) {
+		mm_packet zero = mmp_set1(0), half = mmp_set1(0.5);
+		int all = (1 << MMATH_PACKET_WIDTH) - 1;
+		VEC_FOR(9) {
+			q[i] = m[i];
+		}
+		for (int k = 0; k < MMATH_POLAR_ITERATIONS; k++) {
+			mm_packet cof[9];
+			VEC_FOR(3) {
+				const mm_packet *r1 = &q[((i + 1) % 3) * 3], *r2 = &q[((i + 2) % 3) * 3];
+				cof[i * 3 + 0] = mmp_sub(mmp_mul(r1[1], r2[2]), mmp_mul(r1[2], r2[1]));
+				cof[i * 3 + 1] = mmp_sub(mmp_mul(r1[2], r2[0]), mmp_mul(r1[0], r2[2]));
+				cof[i * 3 + 2] = mmp_sub(mmp_mul(r1[0], r2[1]), mmp_mul(r1[1], r2[0]));
+			}
+			mm_packet det = mmp_add(mmp_add(mmp_mul(q[0], cof[0]), mmp_mul(q[1], cof[1])), mmp_mul(q[2], cof[2]));
+			mm_packet absDet = mmp_max(det, mmp_sub(zero, det));
+			mm_mask ok = mmp_lt(zero, absDet);
+
+			mm_packet nq = zero, nc = zero;
+			VEC_FOR(9) {
+				nq = mmp_add(nq, mmp_mul(q[i], q[i]));
+				nc = mmp_add(nc, mmp_mul(cof[i], cof[i]));
+			}
+			mm_packet g = mmp_sqrt(mmp_div(mmp_sqrt(mmp_div(nc, nq)), absDet));
+			mm_packet gq = mmp_mul(half, g), gc = mmp_div(half, mmp_mul(g, det));
+			mm_packet diff = zero;
+			VEC_FOR(9) {
+				mm_packet next = mmp_select(ok, mmp_add(mmp_mul(q[i], gq), mmp_mul(cof[i], gc)), q[i]);
+				mm_packet d = mmp_sub(next, q[i]);
+				diff = mmp_add(diff, mmp_max(d, mmp_sub(zero, d)));
+				q[i] = next;
+			}
+			if (mmp_movemask(mmp_lt(diff, mmp_set1(MMATH_POLAR_EPSILON))) == all) {
+				break;
+			}
+		}
+		if (stretch) {
+			MAT_FOR(3) {
+				mm_packet sum = zero;
+				VEC_FOR(3) {
+					sum = mmp_add(sum, mmp_mul(q[i * 3 + x], m[i * 3 + y]));
+				}
+				stretch[x * 3 + y] = sum;
+			}
+		}
+	}
+	MMATH_INLINE quat* mat3ToQuatBatch(quat *dest, const mat3 *a, int count) {
+		for (int first = 0; first < count; first += MMATH_PACKET_WIDTH) {
+			int n = count - first < MMATH_PACKET_WIDTH ? count - first : MMATH_PACKET_WIDTH;
+			mm_packet m[9], q[4];
+			VEC_FOR(9) {
+				m[i] = mmp_gather(&a[first].data[i], 9, n);
+			}
+			mat3PacketToQuat(q, m);
+			VEC_FOR(4) {
+				mmp_scatter(&dest[first].data[i], 4, q[i], n);
+			}
+		}
+		return dest;
+	}
+	MMATH_INLINE mat3* mat3PolarBatch(mat3 *rot, mat3 *stretch, const mat3 *a, int count) {
+		for (int first = 0; first < count; first += MMATH_PACKET_WIDTH) {
+			int n = count - first < MMATH_PACKET_WIDTH ? count - first : MMATH_PACKET_WIDTH;
+			mm_packet m[9], q[9], p[9];
+			VEC_FOR(9) {
+				m[i] = mmp_gather(&a[first].data[i], 9, n);
+			}
+			mat3PacketPolar(q, stretch ? p : NULL, m);
+			VEC_FOR(9) {
+				mmp_scatter(&rot[first].data[i], 9, q[i], n);
+				if (stretch) {
+					mmp_scatter(&stretch[first].data[i], 9, p[i], n);
+				}
+			}
+		}
+		return rot;
+	}
 	MMATH_INLINE mat3* mat3RotateX(mat3 *dest, scalar r) {
 		scalar c = mm_cos(r);
 		scalar s = mm_sin(r);
@@ -652,7 +1094,80 @@ extern "C" {
 		return dest;
 	}
 
+	#if defined(MMATH_AVX_DOUBLE)
+	//one AVX register per row
+	MMATH_GENFUNC_MATDIAG(4)
+	MMATH_INLINE mat4* mat4Transpose(mat4 *dest, const mat4 *a) {
+		__m256d r0 = _mm256_loadu_pd(a->r0.data);
+		__m256d r1 = _mm256_loadu_pd(a->r1.data);
+		__m256d r2 = _mm256_loadu_pd(a->r2.data);
+		__m256d r3 = _mm256_loadu_pd(a->r3.data);
+		__m256d t0 = _mm256_unpacklo_pd(r0, r1); //x0 x1 z0 z1
+		__m256d t1 = _mm256_unpackhi_pd(r0, r1); //y0 y1 w0 w1
+		__m256d t2 = _mm256_unpacklo_pd(r2, r3);
+		__m256d t3 = _mm256_unpackhi_pd(r2, r3);
+		_mm256_storeu_pd(dest->r0.data, _mm256_permute2f128_pd(t0, t2, 0x20));
+		_mm256_storeu_pd(dest->r1.data, _mm256_permute2f128_pd(t1, t3, 0x20));
+		_mm256_storeu_pd(dest->r2.data, _mm256_permute2f128_pd(t0, t2, 0x31));
+		_mm256_storeu_pd(dest->r3.data, _mm256_permute2f128_pd(t1, t3, 0x31));
+		return dest;
+	}
+	MMATH_INLINE mat4* mat4Add(mat4 *dest, const mat4 *a, const mat4 *b) {
+		VEC_FOR(4) {
+			vec4Add(&dest->row[i], &a->row[i], &b->row[i]);
+		}
+		return dest;
+	}
+	MMATH_INLINE mat4* mat4Sub(mat4 *dest, const mat4 *a, const mat4 *b) {
+		VEC_FOR(4) {
+			vec4Sub(&dest->row[i], &a->row[i], &b->row[i]);
+		}
+		return dest;
+	}
+	MMATH_INLINE mat4* mat4MulScalar(mat4 *dest, const mat4 *a, scalar b) {
+		VEC_FOR(4) {
+			vec4MulScalar(&dest->row[i], &a->row[i], b);
+		}
+		return dest;
+	}
+	MMATH_INLINE mat4* mat4Mul(mat4 *dest, const mat4 *a, const mat4 *b) {
+		__m256d b0 = _mm256_loadu_pd(b->r0.data);
+		__m256d b1 = _mm256_loadu_pd(b->r1.data);
+		__m256d b2 = _mm256_loadu_pd(b->r2.data);
+		__m256d b3 = _mm256_loadu_pd(b->r3.data);
+		VEC_FOR(4) {
+			const vec4 *r = &a->row[i];
+			__m256d sum = _mm256_mul_pd(_mm256_set1_pd(r->x), b0);
+			sum = mmd_fmadd(_mm256_set1_pd(r->y), b1, sum);
+			sum = mmd_fmadd(_mm256_set1_pd(r->z), b2, sum);
+			sum = mmd_fmadd(_mm256_set1_pd(r->w), b3, sum);
+			_mm256_storeu_pd(dest->row[i].data, sum);
+		}
+		return dest;
+	}
+	MMATH_INLINE vec4* mat4MulVec4(vec4 *dest, const mat4 *a, const vec4 *b) {
+		__m256d sum = _mm256_mul_pd(_mm256_set1_pd(b->x), _mm256_loadu_pd(a->r0.data));
+		sum = mmd_fmadd(_mm256_set1_pd(b->y), _mm256_loadu_pd(a->r1.data), sum);
+		sum = mmd_fmadd(_mm256_set1_pd(b->z), _mm256_loadu_pd(a->r2.data), sum);
+		sum = mmd_fmadd(_mm256_set1_pd(b->w), _mm256_loadu_pd(a->r3.data), sum);
+		_mm256_storeu_pd(dest->data, sum);
+		return dest;
+	}
+	#else
 	MMATH_GENFUNC_MATSTANDARD(4)
+	#endif
+	MMATH_INLINE mat4* mat4MulBatch(mat4 *dest, const mat4 *a, const mat4 *b, int count) {
+		for (int i = 0; i < count; i++) {
+			mat4Mul(&dest[i], &a[i], &b[i]);
+		}
+		return dest;
+	}
+	MMATH_INLINE vec4* mat4MulVec4Batch(vec4 *dest, const mat4 *a, const vec4 *b, int count) {
+		for (int i = 0; i < count; i++) {
+			mat4MulVec4(&dest[i], a, &b[i]);
+		}
+		return dest;
+	}
 	MMATH_CONST mat4 mat4Identity = {
 		1, 0, 0, 0,
 		0, 1, 0, 0,
@@ -753,6 +1268,16 @@ extern "C" {
 	//Transformations
 	MMATH_CONST transform transformIdentity = { {0,0,0}, {1,1,1}, {0,0,0,1} };
 	MMATH_INLINE mat4* transformToMat4(mat4 *dest, const transform *t) {
+	#if defined(MMATH_AVX_DOUBLE)
+		mat3 r;
+		quatToMat3(&r, &t->rot);
+		__m256d s = _mm256_setr_pd(t->scale.x, t->scale.y, t->scale.z, 0);
+		VEC_FOR(3) {
+			_mm256_storeu_pd(dest->row[i].data, _mm256_mul_pd(_mm256_setr_pd(r.row[i].x, r.row[i].y, r.row[i].z, 0), s));
+		}
+		_mm256_storeu_pd(dest->r3.data, _mm256_setr_pd(t->pos.x, t->pos.y, t->pos.z, 1));
+		return dest;
+	#else
 		mat4 ret = {
 			t->scale.x, 0, 0, 0,
 			0, t->scale.y, 0, 0,
@@ -763,6 +1288,106 @@ extern "C" {
 		quatToMat4(&rotate, &t->rot);
 		mat4Mul(dest, &rotate, &ret);
 		return dest;
+	#endif
+	}
+	MMATH_INLINE mat4* transformToMat4Batch(mat4 *dest, const transform *t, int count) {
+		for (int i = 0; i < count; i++) {
+			transformToMat4(&dest[i], &t[i]);
+		}
+		return dest;
+	}
+	//Inverse of transformToMat4, a must not contain shear
+	MMATH_INLINE transform* mat4ToTransform(transform *dest, const mat4 *a) {
+		mat3 r;
+		mat4ToMat3(&r, a);
+		vec3 scale;
+		VEC_FOR(3) {
+			scale.data[i] = mm_sqrt(r.r0.data[i] * r.r0.data[i] + r.r1.data[i] * r.r1.data[i] + r.r2.data[i] * r.r2.data[i]);
+		}
+		if (mat3Determinant(&r) < 0) {
+			scale.x = -scale.x;
+		}
+		VEC_FOR(3) {
+			scalar inv = scale.data[i] != 0 ? (scalar)1.0 / scale.data[i] : 0;
+			r.r0.data[i] *= inv;
+			r.r1.data[i] *= inv;
+			r.r2.data[i] *= inv;
+		}
+		mat3ToQuat(&dest->rot, &r);
+		dest->scale = scale;
+		vec4ToVec3(&dest->pos, &a->r3);
+		return dest;
+	}
+	//Like mat4ToTransform but orthonormalizes the rotation first, shear is dropped
+	MMATH_INLINE transform* mat4ToTransformPolar(transform *dest, const mat4 *a) {
+		mat3 m, q, p;
+		mat4ToMat3(&m, a);
+		mat3Polar(&q, &p, &m);
+		//keep the rotation proper by moving a reflection into scale.x
+		if (mat3Determinant(&q) < 0) {
+			q.x0 = -q.x0; q.x1 = -q.x1; q.x2 = -q.x2;
+			vec3Negate(&p.r0, &p.r0);
+		}
+		mat3ToQuat(&dest->rot, &q);
+		dest->scale.x = p.x0;
+		dest->scale.y = p.y1;
+		dest->scale.z = p.z2;
+		vec4ToVec3(&dest->pos, &a->r3);
+		return dest;
+	}
+	MMATH_INLINE transform* mat4ToTransformPackets(transform *dest, const mat4 *a, int count, int polar) {
+		const int stride = (int)(sizeof(transform) / sizeof(scalar));
+		mm_packet zero = mmp_set1(0), one = mmp_set1(1);
+		for (int first = 0; first < count; first += MMATH_PACKET_WIDTH) {
+			int n = count - first < MMATH_PACKET_WIDTH ? count - first : MMATH_PACKET_WIDTH;
+			mm_packet m[9], r[9], q[4], scale[3];
+			MAT_FOR(3) {
+				m[x * 3 + y] = mmp_gather(&a[first].data[x * 4 + y], 16, n);
+			}
+
+			if (polar) {
+				mm_packet p[9];
+				mat3PacketPolar(r, p, m);
+				VEC_FOR(3) {
+					scale[i] = p[i * 4];
+				}
+			} else {
+				VEC_FOR(3) {
+					mm_packet len = mmp_sqrt(mmp_add(mmp_add(mmp_mul(m[i], m[i]), mmp_mul(m[3 + i], m[3 + i])), mmp_mul(m[6 + i], m[6 + i])));
+					mm_packet inv = mmp_select(mmp_lt(zero, len), mmp_div(one, len), zero);
+					r[i] = mmp_mul(m[i], inv);
+					r[3 + i] = mmp_mul(m[3 + i], inv);
+					r[6 + i] = mmp_mul(m[6 + i], inv);
+					scale[i] = len;
+				}
+			}
+			//move a reflection into scale.x
+			mm_packet c0 = mmp_sub(mmp_mul(r[4], r[8]), mmp_mul(r[5], r[7]));
+			mm_packet c1 = mmp_sub(mmp_mul(r[5], r[6]), mmp_mul(r[3], r[8]));
+			mm_packet c2 = mmp_sub(mmp_mul(r[3], r[7]), mmp_mul(r[4], r[6]));
+			mm_packet det = mmp_add(mmp_add(mmp_mul(r[0], c0), mmp_mul(r[1], c1)), mmp_mul(r[2], c2));
+			mm_packet sign = mmp_select(mmp_lt(det, zero), mmp_set1(-1), one);
+			r[0] = mmp_mul(r[0], sign);
+			r[3] = mmp_mul(r[3], sign);
+			r[6] = mmp_mul(r[6], sign);
+			scale[0] = mmp_mul(scale[0], sign);
+
+			mat3PacketToQuat(q, r);
+			VEC_FOR(3) {
+				mmp_scatter(&dest[first].scale.data[i], stride, scale[i], n);
+				mmp_scatter(&dest[first].pos.data[i], stride, mmp_gather(&a[first].data[12 + i], 16, n), n);
+			}
+			VEC_FOR(4) {
+				mmp_scatter(&dest[first].rot.data[i], stride, q[i], n);
+			}
+		}
+		return dest;
+	}
+	MMATH_INLINE transform* mat4ToTransformBatch(transform *dest, const mat4 *a, int count) {
+		return mat4ToTransformPackets(dest, a, count, 0);
+	}
+	MMATH_INLINE transform* mat4ToTransformPolarBatch(transform *dest, const mat4 *a, int count) {
+		return mat4ToTransformPackets(dest, a, count, 1);
 	}
 	//TODO: Solve transform inverse (this could mean a lot)
 	MMATH_INLINE transform* transformMul(transform *dest, const transform *a, const transform *b) {
@@ -777,12 +1402,861 @@ extern "C" {
 		quatMul(&dest->rot, &a->rot, &b->rot);
 		return dest;
 	}
+	MMATH_INLINE transform* transformMulBatch(transform *dest, const transform *a, const transform *b, int count) {
+		for (int i = 0; i < count; i++) {
+			transformMul(&dest[i], &a[i], &b[i]);
+		}
+		return dest;
+	}
 	MMATH_INLINE transform* transformLerp(transform *dest, const transform *f, const transform *l, scalar t) {
 		vec3Lerp(&dest->pos, &f->pos, &l->pos, t);
 		vec3Lerp(&dest->scale, &f->scale, &l->scale, t);
 		quatSlerp(&dest->rot, &f->rot, &l->rot, t);
 		return dest;
 	}
+	MMATH_INLINE transform* transformLerpBatch(transform *dest, const transform *f, const transform *l, scalar t, int count) {
+		for (int i = 0; i < count; i++) {
+			transformLerp(&dest[i], &f[i], &l[i], t);
+		}
+		return dest;
+	}
+
+	//Snapshots
+	//Hands transform arrays from one writer thread to reader threads without locks.
+	//Readers pin the last two published slots, the writer only ever fills unpinned slots,
+	//so a buffer needs MMATH_SNAPSHOT_SLOTS(readers) slots for publishing to never fail.
+	//That guarantee holds for up to 6 readers, more would need more than MMATH_SNAPSHOT_MAX_SLOTS.
+	#define MMATH_SNAPSHOT_MAX_SLOTS 16
+	#define MMATH_SNAPSHOT_SLOTS(readers) (2 * (readers) + 3)
+	typedef struct snapshotBuffer_t {
+		transform *data;
+		int count;
+		int slotCount;
+		int writing;
+		long state; //publish count << 8 | prev slot << 4 | latest slot
+		long pins[MMATH_SNAPSHOT_MAX_SLOTS];
+	} snapshotBuffer;
+	typedef struct snapshotView_t {
+		const transform *prev;
+		const transform *latest;
+		int prevSlot;
+		int latestSlot;
+	} snapshotView;
+
+	//data must hold slotCount * count transforms, initial may be NULL for identities
+	//Returns NULL if slotCount is above MMATH_SNAPSHOT_MAX_SLOTS
+	MMATH_INLINE snapshotBuffer* snapshotInit(snapshotBuffer *dest, transform *data, int count, int slotCount, const transform *initial) {
+		if (slotCount > MMATH_SNAPSHOT_MAX_SLOTS) {
+			return NULL;
+		}
+		dest->data = data;
+		dest->count = count;
+		dest->slotCount = slotCount;
+		dest->writing = -1;
+		dest->state = 0;
+		for (int i = 0; i < MMATH_SNAPSHOT_MAX_SLOTS; i++) {
+			dest->pins[i] = 0;
+		}
+		for (int i = 0; i < count; i++) {
+			data[i] = initial ? initial[i] : transformIdentity;
+		}
+		return dest;
+	}
+	//Writer: returns the array to fill for the next state, or NULL if every free slot is pinned
+	MMATH_INLINE transform* snapshotBegin(snapshotBuffer *s) {
+		long state = mm_atomic_load(&s->state);
+		int latest = (int)(state & 15);
+		int prev = (int)((state >> 4) & 15);
+		for (int i = 0; i < s->slotCount; i++) {
+			if (i != latest && i != prev && mm_atomic_load(&s->pins[i]) == 0) {
+				s->writing = i;
+				return &s->data[i * s->count];
+			}
+		}
+		s->writing = -1;
+		return NULL;
+	}
+	//Writer: makes the array from snapshotBegin the latest state
+	MMATH_INLINE void snapshotPublish(snapshotBuffer *s) {
+		if (s->writing < 0) {
+			return;
+		}
+		long state = mm_atomic_load(&s->state);
+		long seq = ((state >> 8) + 1) & 0x7fffff;
+		mm_atomic_store(&s->state, (seq << 8) | ((state & 15) << 4) | s->writing);
+		s->writing = -1;
+	}
+	//Reader: pins the last two published states, retries only if the writer publishes meanwhile
+	MMATH_INLINE snapshotView* snapshotAcquire(snapshotBuffer *s, snapshotView *view) {
+		for (;;) {
+			long state = mm_atomic_load(&s->state);
+			int latest = (int)(state & 15);
+			int prev = (int)((state >> 4) & 15);
+			mm_atomic_add(&s->pins[latest], 1);
+			mm_atomic_add(&s->pins[prev], 1);
+			if (mm_atomic_load(&s->state) == state) {
+				view->latestSlot = latest;
+				view->prevSlot = prev;
+				view->latest = &s->data[latest * s->count];
+				view->prev = &s->data[prev * s->count];
+				return view;
+			}
+			mm_atomic_add(&s->pins[latest], -1);
+			mm_atomic_add(&s->pins[prev], -1);
+		}
+	}
+	MMATH_INLINE void snapshotRelease(snapshotBuffer *s, const snapshotView *view) {
+		mm_atomic_add(&s->pins[view->latestSlot], -1);
+		mm_atomic_add(&s->pins[view->prevSlot], -1);
+	}
+	//Reader: interpolates from the previous to the latest state, dest holds count transforms
+	MMATH_INLINE transform* snapshotLerp(transform *dest, snapshotBuffer *s, scalar alpha) {
+		snapshotView view;
+		snapshotAcquire(s, &view);
+		transformLerpBatch(dest, view.prev, view.latest, alpha, s->count);
+		snapshotRelease(s, &view);
+		return dest;
+	}
+
+	//Vertex Transforms
+	//Tangent w holds the bitangent handedness
+	typedef struct vertex_t {
+		vec3 pos;
+		vec3 normal;
+		vec4 tangent;
+	} vertex;
+
+	//Inverse transpose of the upper 3x3, uniform scale skips the inverse
+	MMATH_INLINE mat3* mat4NormalMatrix(mat3 *dest, const mat4 *a) {
+		mat3 m;
+		mat4ToMat3(&m, a);
+		scalar l0 = vec3Dot(&m.r0, &m.r0);
+		scalar d01 = vec3Dot(&m.r0, &m.r1);
+		scalar d02 = vec3Dot(&m.r0, &m.r2);
+		scalar d12 = vec3Dot(&m.r1, &m.r2);
+		scalar eps = l0 * (scalar)0.00001;
+		if (mm_abs(vec3Dot(&m.r1, &m.r1) - l0) <= eps && mm_abs(vec3Dot(&m.r2, &m.r2) - l0) <= eps &&
+		    mm_abs(d01) <= eps && mm_abs(d02) <= eps && mm_abs(d12) <= eps && l0 > 0) {
+			mat3MulScalar(dest, &m, (scalar)1.0 / l0);
+			return dest;
+		}
+		mat3 inv = mat3Identity;
+		mat3Inverse(&inv, &m);
+		return mat3Transpose(dest, &inv);
+	}
+	//Transforms positions by a, normals by its normal matrix and tangents by its upper 3x3 in one pass.
+	//Normals and tangents are renormalized, a must be affine. dest may be src.
+	MMATH_INLINE vertex* vertexTransformBatch(vertex *dest, const vertex *src, const mat4 *a, int count) {
+		const int stride = (int)(sizeof(vertex) / sizeof(scalar));
+		mat3 n;
+		mat4NormalMatrix(&n, a);
+		mm_packet m[12], nm[9];
+		VEC_FOR(12) {
+			m[i] = mmp_set1(a->data[(i / 3) * 4 + i % 3]);
+		}
+		VEC_FOR(9) {
+			nm[i] = mmp_set1(n.data[i]);
+		}
+		mm_packet zero = mmp_set1(0);
+		mm_packet hand = mmp_set1(mat3Determinant(&n) < 0 ? -1 : 1);
+
+		for (int first = 0; first < count; first += MMATH_PACKET_WIDTH) {
+			int cnt = count - first < MMATH_PACKET_WIDTH ? count - first : MMATH_PACKET_WIDTH;
+			mm_packet p[3], nv[3], tv[4];
+			VEC_FOR(3) {
+				p[i] = mmp_gather(&src[first].pos.data[i], stride, cnt);
+				nv[i] = mmp_gather(&src[first].normal.data[i], stride, cnt);
+			}
+			VEC_FOR(4) {
+				tv[i] = mmp_gather(&src[first].tangent.data[i], stride, cnt);
+			}
+
+			mm_packet po[3], no[3], to[3];
+			VEC_FOR(3) {
+				po[i] = mmp_add(mmp_add(mmp_mul(p[0], m[i]), mmp_mul(p[1], m[3 + i])), mmp_add(mmp_mul(p[2], m[6 + i]), m[9 + i]));
+				no[i] = mmp_add(mmp_add(mmp_mul(nv[0], nm[i]), mmp_mul(nv[1], nm[3 + i])), mmp_mul(nv[2], nm[6 + i]));
+				to[i] = mmp_add(mmp_add(mmp_mul(tv[0], m[i]), mmp_mul(tv[1], m[3 + i])), mmp_mul(tv[2], m[6 + i]));
+			}
+			mm_packet nl = mmp_add(mmp_add(mmp_mul(no[0], no[0]), mmp_mul(no[1], no[1])), mmp_mul(no[2], no[2]));
+			mm_packet tl = mmp_add(mmp_add(mmp_mul(to[0], to[0]), mmp_mul(to[1], to[1])), mmp_mul(to[2], to[2]));
+			//zero length vectors stay zero
+			nl = mmp_select(mmp_lt(zero, nl), mmp_rsqrt(nl), zero);
+			tl = mmp_select(mmp_lt(zero, tl), mmp_rsqrt(tl), zero);
+
+			VEC_FOR(3) {
+				mmp_scatter(&dest[first].pos.data[i], stride, po[i], cnt);
+				mmp_scatter(&dest[first].normal.data[i], stride, mmp_mul(no[i], nl), cnt);
+				mmp_scatter(&dest[first].tangent.data[i], stride, mmp_mul(to[i], tl), cnt);
+			}
+			mmp_scatter(&dest[first].tangent.w, stride, mmp_mul(tv[3], hand), cnt);
+		}
+		return dest;
+	}
+
+	//Splines
+	//A cubic segment in power form: coef[0] t^3 + coef[1] t^2 + coef[2] t + coef[3]
+	typedef struct spline3_t {
+		vec3 coef[4];
+	} spline3;
+	//Maps uniform arc-length steps to spline parameters, u holds count >= 2 entries
+	typedef struct arcTable_t {
+		scalar *u;
+		int count;
+		scalar length;
+	} arcTable;
+
+	//basis rows produce coef[0..3] from 4 control values
+	MMATH_CONST mat4 splineBezierBasis = {
+		-1,  3, -3,  1,
+		 3, -6,  3,  0,
+		-3,  3,  0,  0,
+		 1,  0,  0,  0
+	};
+	//control values are p0, m0, p1, m1
+	MMATH_CONST mat4 splineHermiteBasis = {
+		 2,  1, -2,  1,
+		-3, -2,  3, -1,
+		 0,  1,  0,  0,
+		 1,  0,  0,  0
+	};
+	//uniform Catmull-Rom between p1 and p2
+	MMATH_CONST mat4 splineCatmullRomBasis = {
+		-0.5f,  1.5f, -1.5f,  0.5f,
+		 1.0f, -2.5f,  2.0f, -0.5f,
+		-0.5f,  0.0f,  0.5f,  0.0f,
+		 0.0f,  1.0f,  0.0f,  0.0f
+	};
+	MMATH_INLINE spline3* spline3FromBasis(spline3 *dest, const mat4 *basis, const vec3 *c0, const vec3 *c1, const vec3 *c2, const vec3 *c3) {
+		spline3 ret;
+		VEC_FOR(4) {
+			for (int j = 0; j < 3; j++) {
+				ret.coef[i].data[j] = basis->row[i].x * c0->data[j] + basis->row[i].y * c1->data[j] +
+				                      basis->row[i].z * c2->data[j] + basis->row[i].w * c3->data[j];
+			}
+		}
+		*dest = ret;
+		return dest;
+	}
+	MMATH_INLINE spline3* spline3Bezier(spline3 *dest, const vec3 *p0, const vec3 *p1, const vec3 *p2, const vec3 *p3) {
+		return spline3FromBasis(dest, &splineBezierBasis, p0, p1, p2, p3);
+	}
+	MMATH_INLINE spline3* spline3Hermite(spline3 *dest, const vec3 *p0, const vec3 *m0, const vec3 *p1, const vec3 *m1) {
+		return spline3FromBasis(dest, &splineHermiteBasis, p0, m0, p1, m1);
+	}
+	MMATH_INLINE spline3* spline3CatmullRom(spline3 *dest, const vec3 *p0, const vec3 *p1, const vec3 *p2, const vec3 *p3) {
+		return spline3FromBasis(dest, &splineCatmullRomBasis, p0, p1, p2, p3);
+	}
+	//Builds pointCount - 1 segments through every point, the end points are repeated
+	MMATH_INLINE spline3* spline3CatmullRomPath(spline3 *dest, const vec3 *points, int pointCount) {
+		for (int i = 0; i < pointCount - 1; i++) {
+			const vec3 *p0 = &points[i > 0 ? i - 1 : 0];
+			const vec3 *p3 = &points[i + 2 < pointCount ? i + 2 : pointCount - 1];
+			spline3CatmullRom(&dest[i], p0, &points[i], &points[i + 1], p3);
+		}
+		return dest;
+	}
+	MMATH_INLINE vec3* spline3Eval(vec3 *dest, const spline3 *a, scalar t) {
+		VEC_FOR(3) {
+			dest->data[i] = ((a->coef[0].data[i] * t + a->coef[1].data[i]) * t + a->coef[2].data[i]) * t + a->coef[3].data[i];
+		}
+		return dest;
+	}
+	MMATH_INLINE vec3* spline3Tangent(vec3 *dest, const spline3 *a, scalar t) {
+		VEC_FOR(3) {
+			dest->data[i] = (3 * a->coef[0].data[i] * t + 2 * a->coef[1].data[i]) * t + a->coef[2].data[i];
+		}
+		return dest;
+	}
+	//u runs from 0 to segCount over a path of segments, returns the local t
+	//segCount must be at least 1 here and in every path function below
+	MMATH_INLINE scalar spline3Segment(int *seg, int segCount, scalar u) {
+		int s = u > 0 ? (int)u : 0;
+		*seg = s < segCount ? s : segCount - 1;
+		return u - (scalar)*seg;
+	}
+	MMATH_INLINE vec3* spline3EvalPath(vec3 *dest, const spline3 *segs, int segCount, scalar u) {
+		int seg;
+		scalar t = spline3Segment(&seg, segCount, u);
+		return spline3Eval(dest, &segs[seg], t);
+	}
+	MMATH_INLINE void spline3EvalBatch(vec3 *dest, const spline3 *segs, int segCount, const scalar *u, int count) {
+		for (int first = 0; first < count; first += MMATH_PACKET_WIDTH) {
+			int n = count - first < MMATH_PACKET_WIDTH ? count - first : MMATH_PACKET_WIDTH;
+			scalar t[MMATH_PACKET_WIDTH], c[4][3][MMATH_PACKET_WIDTH], out[3][MMATH_PACKET_WIDTH];
+			for (int l = 0; l < MMATH_PACKET_WIDTH; l++) {
+				int seg;
+				t[l] = spline3Segment(&seg, segCount, u[first + (l < n ? l : 0)]);
+				VEC_FOR(4) {
+					for (int j = 0; j < 3; j++) {
+						c[i][j][l] = segs[seg].coef[i].data[j];
+					}
+				}
+			}
+			mm_packet tp = mmp_load(t);
+			VEC_FOR(3) {
+				mm_packet r = mmp_load(c[0][i]);
+				r = mmp_add(mmp_mul(r, tp), mmp_load(c[1][i]));
+				r = mmp_add(mmp_mul(r, tp), mmp_load(c[2][i]));
+				r = mmp_add(mmp_mul(r, tp), mmp_load(c[3][i]));
+				mmp_store(out[i], r);
+			}
+			for (int l = 0; l < n; l++) {
+				dest[first + l].x = out[0][l];
+				dest[first + l].y = out[1][l];
+				dest[first + l].z = out[2][l];
+			}
+		}
+	}
+
+	//Arc length tables, integrated once with MMATH_ARC_OVERSAMPLE chords per table step
+	#define MMATH_ARC_OVERSAMPLE 8
+	MMATH_INLINE arcTable* arcTableBuild(arcTable *dest, scalar *u, int count, const spline3 *segs, int segCount) {
+		int steps = (count - 1) * MMATH_ARC_OVERSAMPLE;
+		scalar du = (scalar)segCount / steps;
+		dest->u = u;
+		dest->count = count;
+		dest->length = 0;
+
+		vec3 prev, cur;
+		spline3EvalPath(&prev, segs, segCount, 0);
+		for (int k = 1; k <= steps; k++) {
+			spline3EvalPath(&cur, segs, segCount, k * du);
+			dest->length += vec3Distance(&prev, &cur);
+			prev = cur;
+		}
+
+		u[0] = 0;
+		u[count - 1] = (scalar)segCount;
+		if (dest->length <= 0) {
+			for (int j = 1; j < count - 1; j++) {
+				u[j] = j * (scalar)MMATH_ARC_OVERSAMPLE * du;
+			}
+			return dest;
+		}
+		scalar step = dest->length / (count - 1);
+		scalar acc = 0;
+		int j = 1;
+		spline3EvalPath(&prev, segs, segCount, 0);
+		for (int k = 1; k <= steps && j < count - 1; k++) {
+			spline3EvalPath(&cur, segs, segCount, k * du);
+			scalar d = vec3Distance(&prev, &cur);
+			for (; j < count - 1 && acc + d >= j * step; j++) {
+				u[j] = (k - 1 + (j * step - acc) / d) * du;
+			}
+			acc += d;
+			prev = cur;
+		}
+		for (; j < count - 1; j++) {
+			u[j] = (scalar)segCount;
+		}
+		return dest;
+	}
+	//Spline parameter at distance s along the path
+	MMATH_INLINE scalar arcTableParam(const arcTable *a, scalar s) {
+		if (a->length <= 0) {
+			return s > 0 ? a->u[a->count - 1] : a->u[0];
+		}
+		//clamp before converting so far off distances cannot overflow the index
+		scalar x = s * (a->count - 1) / a->length;
+		x = mm_min(mm_max(x, (scalar)0), (scalar)(a->count - 1));
+		int i = (int)x;
+		i = i < a->count - 2 ? i : a->count - 2;
+		scalar f = x - i;
+		return a->u[i] + (a->u[i + 1] - a->u[i]) * f;
+	}
+	MMATH_INLINE void arcTableParamBatch(scalar *dest, const arcTable *a, const scalar *s, int count) {
+		for (int i = 0; i < count; i++) {
+			dest[i] = arcTableParam(a, s[i]);
+		}
+	}
+	//Constant speed evaluation, s holds distances along the path
+	MMATH_INLINE void spline3EvalDistanceBatch(vec3 *dest, const spline3 *segs, int segCount, const arcTable *a, const scalar *s, int count) {
+		for (int first = 0; first < count; first += MMATH_PACKET_WIDTH) {
+			int n = count - first < MMATH_PACKET_WIDTH ? count - first : MMATH_PACKET_WIDTH;
+			scalar u[MMATH_PACKET_WIDTH];
+			arcTableParamBatch(u, a, s + first, n);
+			spline3EvalBatch(dest + first, segs, segCount, u, n);
+		}
+	}
+
+	//Squad over quaternion keys, ctrls hold one inner control per key
+	MMATH_INLINE quat* quatSquadControls(quat *ctrls, const quat *keys, int keyCount) {
+		for (int i = 0; i < keyCount; i++) {
+			const quat *cur = &keys[i];
+			quat prev = keys[i > 0 ? i - 1 : 0];
+			quat next = keys[i + 1 < keyCount ? i + 1 : keyCount - 1];
+			if (vec4Dot(&prev.vec, &cur->vec) < 0) {
+				quatNegate(&prev, &prev);
+			}
+			if (vec4Dot(&next.vec, &cur->vec) < 0) {
+				quatNegate(&next, &next);
+			}
+
+			quat inv, a, b, la, lb, sum;
+			quatConjugate(&inv, cur);
+			quatLog(&la, quatMul(&a, &inv, &next));
+			quatLog(&lb, quatMul(&b, &inv, &prev));
+			quatAdd(&sum, &la, &lb);
+			quatMulScalar(&sum, &sum, (scalar)-0.25);
+			quatExp(&a, &sum);
+			quatMul(&ctrls[i], cur, &a);
+		}
+		return ctrls;
+	}
+	MMATH_INLINE quat* quatSquad(quat *dest, const quat *q0, const quat *q1, const quat *s0, const quat *s1, scalar t) {
+		quat a, b;
+		quatSlerpDirect(&a, q0, q1, t);
+		quatSlerpDirect(&b, s0, s1, t);
+		return quatSlerpDirect(dest, &a, &b, 2 * t * (1 - t));
+	}
+	//u runs from 0 to keyCount - 1, keyCount must be at least 2
+	MMATH_INLINE void quatSquadBatch(quat *dest, const quat *keys, const quat *ctrls, int keyCount, const scalar *u, int count) {
+		for (int i = 0; i < count; i++) {
+			int seg;
+			scalar t = spline3Segment(&seg, keyCount - 1, u[i]);
+			quat next = keys[seg + 1];
+			quat nextCtrl = ctrls[seg + 1];
+			if (vec4Dot(&keys[seg].vec, &next.vec) < 0) {
+				quatNegate(&next, &next);
+				quatNegate(&nextCtrl, &nextCtrl);
+			}
+			quatSquad(&dest[i], &keys[seg], &next, &ctrls[seg], &nextCtrl, t);
+		}
+	}
+
+	//Ray Intersection
+	#define MMATH_RAY_EPSILON ((scalar)0.000001)
+	#define MMATH_RAY_INV_MAX ((scalar)1e30) //finite stand-in for 1 / 0 in the slab test
+	typedef struct sphere_t {
+		vec3 center;
+		scalar radius;
+	} sphere;
+	typedef struct aabb_t {
+		vec3 min;
+		vec3 max;
+	} aabb;
+	//SoA batch of rays, directions do not need to be normalized
+	typedef struct rayBatch_t {
+		const scalar *ox, *oy, *oz;
+		const scalar *dx, *dy, *dz;
+		int count;
+	} rayBatch;
+	//MMATH_PACKET_WIDTH rays loaded from a rayBatch, t is the nearest hit so far
+	typedef struct rayPacket_t {
+		mm_packet o[3];
+		mm_packet d[3];
+		mm_packet inv[3];
+		mm_packet t;
+	} rayPacket;
+
+	MMATH_CONST aabb aabbEmpty = { {INFINITY, INFINITY, INFINITY}, {-INFINITY, -INFINITY, -INFINITY} };
+	MMATH_INLINE aabb* aabbExtend(aabb *dest, const vec3 *p) {
+		VEC_FOR(3) {
+			dest->min.data[i] = mm_min(dest->min.data[i], p->data[i]);
+			dest->max.data[i] = mm_max(dest->max.data[i], p->data[i]);
+		}
+		return dest;
+	}
+	MMATH_INLINE aabb* aabbUnion(aabb *dest, const aabb *a, const aabb *b) {
+		VEC_FOR(3) {
+			dest->min.data[i] = mm_min(a->min.data[i], b->min.data[i]);
+			dest->max.data[i] = mm_max(a->max.data[i], b->max.data[i]);
+		}
+		return dest;
+	}
+	MMATH_INLINE scalar aabbArea(const aabb *a) {
+		vec3 e;
+		vec3Sub(&e, &a->max, &a->min);
+		if (e.x < 0) {
+			return 0;
+		}
+		return 2 * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+
+	//Loads rays [first, first + MMATH_PACKET_WIDTH) with t as the max distance, returns the number of valid lanes.
+	//Lanes past the end of the batch get t = 0 so they never hit.
+	MMATH_INLINE int rayPacketLoad(rayPacket *dest, const rayBatch *rays, const scalar *t, int first) {
+		int n = rays->count - first;
+		if (n >= MMATH_PACKET_WIDTH) {
+			n = MMATH_PACKET_WIDTH;
+			dest->o[0] = mmp_load(rays->ox + first);
+			dest->o[1] = mmp_load(rays->oy + first);
+			dest->o[2] = mmp_load(rays->oz + first);
+			dest->d[0] = mmp_load(rays->dx + first);
+			dest->d[1] = mmp_load(rays->dy + first);
+			dest->d[2] = mmp_load(rays->dz + first);
+			dest->t    = mmp_load(t + first);
+		} else {
+			scalar buf[7][MMATH_PACKET_WIDTH];
+			for (int l = 0; l < MMATH_PACKET_WIDTH; l++) {
+				int valid = l < n;
+				buf[0][l] = valid ? rays->ox[first + l] : 0;
+				buf[1][l] = valid ? rays->oy[first + l] : 0;
+				buf[2][l] = valid ? rays->oz[first + l] : 0;
+				buf[3][l] = valid ? rays->dx[first + l] : 1;
+				buf[4][l] = valid ? rays->dy[first + l] : 1;
+				buf[5][l] = valid ? rays->dz[first + l] : 1;
+				buf[6][l] = valid ? t[first + l]        : 0;
+			}
+			VEC_FOR(3) {
+				dest->o[i] = mmp_load(buf[i]);
+				dest->d[i] = mmp_load(buf[i + 3]);
+			}
+			dest->t = mmp_load(buf[6]);
+		}
+		//clamping keeps (bound - o) * inv at 0 instead of NaN when a ray lies on a box face
+		mm_packet one = mmp_set1(1), big = mmp_set1(MMATH_RAY_INV_MAX);
+		VEC_FOR(3) {
+			dest->inv[i] = mmp_min(mmp_max(mmp_div(one, dest->d[i]), mmp_sub(mmp_set1(0), big)), big);
+		}
+		return n;
+	}
+	MMATH_INLINE void rayPacketStoreT(scalar *t, const rayPacket *p, int first, int n) {
+		if (n == MMATH_PACKET_WIDTH) {
+			mmp_store(t + first, p->t);
+		} else {
+			scalar buf[MMATH_PACKET_WIDTH];
+			mmp_store(buf, p->t);
+			for (int l = 0; l < n; l++) {
+				t[first + l] = buf[l];
+			}
+		}
+	}
+	MMATH_INLINE void rayPacketSetHits(int *hit, int mask, int first, int prim) {
+		for (int l = 0; mask; l++, mask >>= 1) {
+			if (mask & 1) {
+				hit[first + l] = prim;
+			}
+		}
+	}
+
+	//Each packet kernel returns a lane mask of the rays whose nearest hit was updated
+	MMATH_INLINE int rayPacketSphere(rayPacket *p, const sphere *s) {
+		mm_packet oc[3];
+		VEC_FOR(3) {
+			oc[i] = mmp_sub(p->o[i], mmp_set1(s->center.data[i]));
+		}
+		mm_packet a = mmp_add(mmp_add(mmp_mul(p->d[0], p->d[0]), mmp_mul(p->d[1], p->d[1])), mmp_mul(p->d[2], p->d[2]));
+		mm_packet b = mmp_add(mmp_add(mmp_mul(oc[0], p->d[0]), mmp_mul(oc[1], p->d[1])), mmp_mul(oc[2], p->d[2]));
+		mm_packet c = mmp_add(mmp_add(mmp_mul(oc[0], oc[0]), mmp_mul(oc[1], oc[1])), mmp_mul(oc[2], oc[2]));
+		c = mmp_sub(c, mmp_set1(s->radius * s->radius));
+
+		mm_packet disc = mmp_sub(mmp_mul(b, b), mmp_mul(a, c));
+		mm_mask valid = mmp_le(mmp_set1(0), disc);
+		mm_packet root = mmp_sqrt(mmp_max(disc, mmp_set1(0)));
+		mm_packet inva = mmp_div(mmp_set1(1), a);
+
+		//take the far root when the origin is inside the sphere
+		mm_packet eps = mmp_set1(MMATH_RAY_EPSILON);
+		mm_packet tn = mmp_mul(mmp_sub(mmp_sub(mmp_set1(0), b), root), inva);
+		mm_packet tf = mmp_mul(mmp_add(mmp_sub(mmp_set1(0), b), root), inva);
+		mm_packet t  = mmp_select(mmp_lt(eps, tn), tn, tf);
+
+		mm_mask m = mmp_and(valid, mmp_and(mmp_lt(eps, t), mmp_lt(t, p->t)));
+		p->t = mmp_select(m, t, p->t);
+		return mmp_movemask(m);
+	}
+	MMATH_INLINE mm_mask rayPacketSlab(const rayPacket *p, const aabb *b, mm_packet *tNear) {
+		mm_packet tmin = mmp_set1(0);
+		mm_packet tmax = p->t;
+		VEC_FOR(3) {
+			mm_packet t1 = mmp_mul(mmp_sub(mmp_set1(b->min.data[i]), p->o[i]), p->inv[i]);
+			mm_packet t2 = mmp_mul(mmp_sub(mmp_set1(b->max.data[i]), p->o[i]), p->inv[i]);
+			tmin = mmp_max(tmin, mmp_min(t1, t2));
+			tmax = mmp_min(tmax, mmp_max(t1, t2));
+		}
+		*tNear = tmin;
+		return mmp_le(tmin, tmax);
+	}
+	//Slab test against the current t without updating it, used for culling
+	MMATH_INLINE int rayPacketAABB(const rayPacket *p, const aabb *b) {
+		mm_packet tNear;
+		return mmp_movemask(rayPacketSlab(p, b, &tNear));
+	}
+	//Slab test that records the entry distance (0 if the origin is inside)
+	MMATH_INLINE int rayPacketAABBNearest(rayPacket *p, const aabb *b) {
+		mm_packet tNear;
+		mm_mask m = rayPacketSlab(p, b, &tNear);
+		m = mmp_and(m, mmp_lt(tNear, p->t));
+		p->t = mmp_select(m, tNear, p->t);
+		return mmp_movemask(m);
+	}
+	//Möller–Trumbore, hits both faces
+	MMATH_INLINE int rayPacketTriangle(rayPacket *p, const vec3 *v0, const vec3 *v1, const vec3 *v2) {
+		vec3 edge1, edge2;
+		vec3Sub(&edge1, v1, v0);
+		vec3Sub(&edge2, v2, v0);
+		mm_packet e1[3], e2[3];
+		VEC_FOR(3) {
+			e1[i] = mmp_set1(edge1.data[i]);
+			e2[i] = mmp_set1(edge2.data[i]);
+		}
+
+		mm_packet pv[3];
+		pv[0] = mmp_sub(mmp_mul(p->d[1], e2[2]), mmp_mul(p->d[2], e2[1]));
+		pv[1] = mmp_sub(mmp_mul(p->d[2], e2[0]), mmp_mul(p->d[0], e2[2]));
+		pv[2] = mmp_sub(mmp_mul(p->d[0], e2[1]), mmp_mul(p->d[1], e2[0]));
+		mm_packet det = mmp_add(mmp_add(mmp_mul(e1[0], pv[0]), mmp_mul(e1[1], pv[1])), mmp_mul(e1[2], pv[2]));
+		mm_packet inv = mmp_div(mmp_set1(1), det);
+
+		mm_packet tv[3];
+		VEC_FOR(3) {
+			tv[i] = mmp_sub(p->o[i], mmp_set1(v0->data[i]));
+		}
+		mm_packet u = mmp_mul(mmp_add(mmp_add(mmp_mul(tv[0], pv[0]), mmp_mul(tv[1], pv[1])), mmp_mul(tv[2], pv[2])), inv);
+
+		mm_packet qv[3];
+		qv[0] = mmp_sub(mmp_mul(tv[1], e1[2]), mmp_mul(tv[2], e1[1]));
+		qv[1] = mmp_sub(mmp_mul(tv[2], e1[0]), mmp_mul(tv[0], e1[2]));
+		qv[2] = mmp_sub(mmp_mul(tv[0], e1[1]), mmp_mul(tv[1], e1[0]));
+		mm_packet v = mmp_mul(mmp_add(mmp_add(mmp_mul(p->d[0], qv[0]), mmp_mul(p->d[1], qv[1])), mmp_mul(p->d[2], qv[2])), inv);
+		mm_packet t = mmp_mul(mmp_add(mmp_add(mmp_mul(e2[0], qv[0]), mmp_mul(e2[1], qv[1])), mmp_mul(e2[2], qv[2])), inv);
+
+		mm_packet zero = mmp_set1(0);
+		mm_packet eps  = mmp_set1(MMATH_RAY_EPSILON);
+		mm_mask m = mmp_or(mmp_lt(eps, det), mmp_lt(det, mmp_set1(-MMATH_RAY_EPSILON)));
+		m = mmp_and(m, mmp_and(mmp_le(zero, u), mmp_le(zero, v)));
+		m = mmp_and(m, mmp_le(mmp_add(u, v), mmp_set1(1)));
+		m = mmp_and(m, mmp_and(mmp_lt(eps, t), mmp_lt(t, p->t)));
+		p->t = mmp_select(m, t, p->t);
+		return mmp_movemask(m);
+	}
+
+	//Batch queries: t holds the max distance of each ray on input and the nearest hit on output,
+	//hit receives the index of the nearest primitive or -1. Returns the number of rays that hit.
+	#define MMATH_GENFUNC_RAYBATCH(name, type, test) \
+	MMATH_INLINE int rayBatch##name(scalar *t, int *hit, const rayBatch *rays, const type *prims, int count) { \
+		int hits = 0; \
+		for (int first = 0; first < rays->count; first += MMATH_PACKET_WIDTH) { \
+			rayPacket p; \
+			int n = rayPacketLoad(&p, rays, t, first); \
+			int any = 0; \
+			for (int l = 0; l < n; l++) { \
+				hit[first + l] = -1; \
+			} \
+			for (int j = 0; j < count; j++) { \
+				int mask = test; \
+				rayPacketSetHits(hit, mask, first, j); \
+				any |= mask; \
+			} \
+			rayPacketStoreT(t, &p, first, n); \
+			for (; any; any &= any - 1) { \
+				hits++; \
+			} \
+		} \
+		return hits; \
+	}
+	MMATH_GENFUNC_RAYBATCH(Spheres, sphere, rayPacketSphere(&p, &prims[j]))
+	MMATH_GENFUNC_RAYBATCH(AABBs, aabb, rayPacketAABBNearest(&p, &prims[j]))
+	//triangles are 3 consecutive vec3, count is the number of triangles
+	MMATH_GENFUNC_RAYBATCH(Triangles, vec3, rayPacketTriangle(&p, &prims[j * 3], &prims[j * 3 + 1], &prims[j * 3 + 2]))
+
+	//Bounding Volume Hierarchy over triangle vec3 arrays, built with binned SAH
+	#define MMATH_BVH_BINS 12
+	#define MMATH_BVH_MAX_LEAF 8
+	#define MMATH_BVH_TRAVERSAL_COST ((scalar)1.0) //relative to one triangle test
+	#define MMATH_BVH_STACK 64
+	//count >= 0: leaf with count triangles at indices[first]
+	//count < 0: inner node with children first and first + 1, split on axis -(count + 1)
+	typedef struct bvhNode_t {
+		aabb bounds;
+		int first;
+		int count;
+	} bvhNode;
+	typedef struct bvh_t {
+		bvhNode *nodes;
+		int *indices;
+		const vec3 *verts;
+		int nodeCount;
+	} bvh;
+
+	MMATH_INLINE scalar bvhCentroid(const bvh *tree, int tri, int axis) {
+		const vec3 *v = &tree->verts[tri * 3];
+		return (v[0].data[axis] + v[1].data[axis] + v[2].data[axis]) * ((scalar)1.0 / 3);
+	}
+	MMATH_INLINE void bvhSubdivide(bvh *tree, int nodeIndex, int depth) {
+		bvhNode *node = &tree->nodes[nodeIndex];
+		int first = node->first, count = node->count;
+
+		node->bounds = aabbEmpty;
+		aabb cbounds = aabbEmpty;
+		for (int j = first; j < first + count; j++) {
+			const vec3 *v = &tree->verts[tree->indices[j] * 3];
+			vec3 c;
+			aabbExtend(&node->bounds, &v[0]);
+			aabbExtend(&node->bounds, &v[1]);
+			aabbExtend(&node->bounds, &v[2]);
+			VEC_FOR(3) {
+				c.data[i] = bvhCentroid(tree, tree->indices[j], i);
+			}
+			aabbExtend(&cbounds, &c);
+		}
+		//depth is capped so traversal never overflows its stack
+		if (count <= 1 || depth >= MMATH_BVH_STACK - 2) {
+			return;
+		}
+
+		int bestAxis = -1, bestSplit = 0;
+		scalar bestCost = INFINITY;
+		for (int axis = 0; axis < 3; axis++) {
+			scalar lo = cbounds.min.data[axis];
+			scalar extent = cbounds.max.data[axis] - lo;
+			if (extent <= 0) {
+				continue;
+			}
+			scalar scale = MMATH_BVH_BINS / extent;
+
+			aabb bins[MMATH_BVH_BINS];
+			int binCount[MMATH_BVH_BINS] = {0};
+			for (int b = 0; b < MMATH_BVH_BINS; b++) {
+				bins[b] = aabbEmpty;
+			}
+			for (int j = first; j < first + count; j++) {
+				int tri = tree->indices[j];
+				int b = (int)((bvhCentroid(tree, tri, axis) - lo) * scale);
+				b = b < MMATH_BVH_BINS - 1 ? b : MMATH_BVH_BINS - 1;
+				const vec3 *v = &tree->verts[tri * 3];
+				aabbExtend(&bins[b], &v[0]);
+				aabbExtend(&bins[b], &v[1]);
+				aabbExtend(&bins[b], &v[2]);
+				binCount[b]++;
+			}
+
+			//sweep from the right, then evaluate each plane while sweeping from the left
+			scalar rightArea[MMATH_BVH_BINS];
+			int rightCount[MMATH_BVH_BINS];
+			aabb acc = aabbEmpty;
+			int sum = 0;
+			for (int b = MMATH_BVH_BINS - 1; b > 0; b--) {
+				aabbUnion(&acc, &acc, &bins[b]);
+				sum += binCount[b];
+				rightArea[b] = aabbArea(&acc);
+				rightCount[b] = sum;
+			}
+			acc = aabbEmpty;
+			sum = 0;
+			for (int b = 1; b < MMATH_BVH_BINS; b++) {
+				aabbUnion(&acc, &acc, &bins[b - 1]);
+				sum += binCount[b - 1];
+				if (sum == 0 || rightCount[b] == 0) {
+					continue;
+				}
+				scalar cost = aabbArea(&acc) * sum + rightArea[b] * rightCount[b];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+
+		//costs are scaled by the node area: traversal + children vs testing every triangle here
+		scalar area = aabbArea(&node->bounds);
+		bestCost += MMATH_BVH_TRAVERSAL_COST * area;
+		if (bestAxis < 0 || (count <= MMATH_BVH_MAX_LEAF && bestCost >= area * count)) {
+			return;
+		}
+
+		scalar lo = cbounds.min.data[bestAxis];
+		scalar scale = MMATH_BVH_BINS / (cbounds.max.data[bestAxis] - lo);
+		int i = first, j = first + count - 1;
+		while (i <= j) {
+			int b = (int)((bvhCentroid(tree, tree->indices[i], bestAxis) - lo) * scale);
+			b = b < MMATH_BVH_BINS - 1 ? b : MMATH_BVH_BINS - 1;
+			if (b < bestSplit) {
+				i++;
+			} else {
+				int temp = tree->indices[i];
+				tree->indices[i] = tree->indices[j];
+				tree->indices[j--] = temp;
+			}
+		}
+
+		int left = tree->nodeCount;
+		tree->nodeCount += 2;
+		tree->nodes[left].first = first;
+		tree->nodes[left].count = i - first;
+		tree->nodes[left + 1].first = i;
+		tree->nodes[left + 1].count = first + count - i;
+		node->first = left;
+		node->count = -(bestAxis + 1);
+
+		bvhSubdivide(tree, left, depth + 1);
+		bvhSubdivide(tree, left + 1, depth + 1);
+	}
+	//nodes must hold 2 * triCount - 1 entries (at least 1) and indices triCount entries, verts must outlive the tree
+	MMATH_INLINE bvh* bvhBuild(bvh *dest, bvhNode *nodes, int *indices, const vec3 *verts, int triCount) {
+		dest->nodes = nodes;
+		dest->indices = indices;
+		dest->verts = verts;
+		dest->nodeCount = 1;
+		for (int i = 0; i < triCount; i++) {
+			indices[i] = i;
+		}
+		nodes[0].first = 0;
+		nodes[0].count = triCount;
+		if (triCount > 0) {
+			bvhSubdivide(dest, 0, 0);
+		} else {
+			nodes[0].bounds = aabbEmpty;
+		}
+		return dest;
+	}
+	//Same contract as the rayBatch queries, hit receives the triangle index
+	MMATH_INLINE int bvhIntersect(scalar *t, int *hit, const bvh *tree, const rayBatch *rays) {
+		int hits = 0;
+		if (tree->nodes[0].count == 0) {
+			for (int i = 0; i < rays->count; i++) {
+				hit[i] = -1;
+			}
+			return 0;
+		}
+		for (int first = 0; first < rays->count; first += MMATH_PACKET_WIDTH) {
+			rayPacket p;
+			int n = rayPacketLoad(&p, rays, t, first);
+			int any = 0;
+			for (int l = 0; l < n; l++) {
+				hit[first + l] = -1;
+			}
+
+			int stack[MMATH_BVH_STACK];
+			int top = 0;
+			stack[top++] = 0;
+			while (top > 0) {
+				const bvhNode *node = &tree->nodes[stack[--top]];
+				int active = rayPacketAABB(&p, &node->bounds);
+				if (!active) {
+					continue;
+				}
+				if (node->count >= 0) {
+					for (int j = node->first; j < node->first + node->count; j++) {
+						int tri = tree->indices[j];
+						const vec3 *v = &tree->verts[tri * 3];
+						int mask = rayPacketTriangle(&p, &v[0], &v[1], &v[2]);
+						rayPacketSetHits(hit, mask, first, tri);
+						any |= mask;
+					}
+				} else {
+					//visit the near child first based on the first active ray
+					scalar dir[MMATH_PACKET_WIDTH];
+					mmp_store(dir, p.d[-(node->count + 1)]);
+					int lane = 0;
+					while (!(active & (1 << lane))) {
+						lane++;
+					}
+					int nearRight = dir[lane] < 0;
+					stack[top++] = node->first + !nearRight;
+					stack[top++] = node->first + nearRight;
+				}
+			}
+
+			rayPacketStoreT(t, &p, first, n);
+			for (; any; any &= any - 1) {
+				hits++;
+			}
+		}
+		return hits;
+	}
 
 #if defined(__cplusplus)
 }
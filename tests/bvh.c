@@ -0,0 +1,202 @@
+/* bvh.c -- checks the packet ray kernels and bvhIntersect against brute force
+ *
+ * Built once with MMATH_NO_SIMD and once with AVX2 + FMA (see Makefile).
+ */
+
+#include "../MMath.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TOLERANCE ((scalar)0.0001)
+#define RAYS 1003 //not a multiple of any packet width, so the last packet has a tail
+#define TRIS 500
+#define GRID 32
+
+static int failures = 0;
+
+static void fail(const char *name, int i) {
+	printf("FAIL %s[%d]\n", name, i);
+	failures++;
+}
+static scalar rnd(void) {
+	return (scalar)rand() / RAND_MAX * 2 - 1;
+}
+
+typedef struct rays_t {
+	scalar ox[RAYS], oy[RAYS], oz[RAYS];
+	scalar dx[RAYS], dy[RAYS], dz[RAYS];
+	rayBatch batch;
+} rays;
+static void raysInit(rays *r, int count) {
+	rayBatch b = { r->ox, r->oy, r->oz, r->dx, r->dy, r->dz, count };
+	r->batch = b;
+}
+
+//bvhIntersect and rayBatchTriangles must agree on which rays hit and where
+static void compareBvh(const char *name, const vec3 *verts, int triCount, const rays *r, int expectHits) {
+	static bvhNode nodes[2 * GRID * GRID * 2];
+	static int indices[GRID * GRID * 2];
+	static scalar tBrute[RAYS], tTree[RAYS];
+	static int hitBrute[RAYS], hitTree[RAYS];
+	bvh tree;
+	bvhBuild(&tree, nodes, indices, verts, triCount);
+
+	int count = r->batch.count;
+	for (int i = 0; i < count; i++) {
+		tBrute[i] = tTree[i] = 1000;
+	}
+	int brute = rayBatchTriangles(tBrute, hitBrute, &r->batch, verts, triCount);
+	int hits = bvhIntersect(tTree, hitTree, &tree, &r->batch);
+	if (brute != hits || (expectHits >= 0 && hits != expectHits)) {
+		printf("FAIL %s: bvh %d hits, brute force %d, expected %d\n", name, hits, brute, expectHits);
+		failures++;
+	}
+	for (int i = 0; i < count; i++) {
+		if ((hitBrute[i] < 0) != (hitTree[i] < 0) || mm_abs(tBrute[i] - tTree[i]) > TOLERANCE) {
+			fail(name, i);
+			return;
+		}
+	}
+}
+
+static void testSoup(void) {
+	static vec3 verts[TRIS * 3];
+	static rays r;
+	for (int i = 0; i < TRIS; i++) {
+		vec3 c = {{{rnd() * 5, rnd() * 5, rnd() * 5}}};
+		for (int k = 0; k < 3; k++) {
+			vec3 o = {{{rnd(), rnd(), rnd()}}};
+			vec3Add(&verts[i * 3 + k], &c, &o);
+		}
+	}
+	for (int i = 0; i < RAYS; i++) {
+		r.ox[i] = rnd() * 5; r.oy[i] = rnd() * 5; r.oz[i] = -10;
+		r.dx[i] = rnd() * (scalar)0.3; r.dy[i] = rnd() * (scalar)0.3; r.dz[i] = 1;
+	}
+	raysInit(&r, RAYS);
+	compareBvh("soup", verts, TRIS, &r, -1);
+}
+
+static void testEmpty(void) {
+	static rays r;
+	bvhNode node;
+	int index;
+	bvh tree;
+	scalar t = 1000;
+	int hit = 0;
+	r.ox[0] = r.oy[0] = r.oz[0] = 0;
+	r.dx[0] = 1; r.dy[0] = r.dz[0] = 0;
+	raysInit(&r, 1);
+	bvhBuild(&tree, &node, &index, NULL, 0);
+	if (bvhIntersect(&t, &hit, &tree, &r.batch) != 0 || hit != -1 || t != 1000) {
+		fail("empty", 0);
+	}
+}
+
+//heightfield of GRID x GRID quads hit by vertical rays at integer coordinates
+static void testGrid(void) {
+	static vec3 verts[GRID * GRID * 6];
+	static rays r;
+	int n = 0;
+	for (int x = 0; x < GRID; x++) {
+		for (int y = 0; y < GRID; y++) {
+			vec3 a = {{{x, y, 0}}}, b = {{{x + 1, y, 0}}}, c = {{{x, y + 1, 0}}}, d = {{{x + 1, y + 1, 0}}};
+			verts[n++] = a; verts[n++] = b; verts[n++] = c;
+			verts[n++] = b; verts[n++] = d; verts[n++] = c;
+		}
+	}
+	for (int i = 0; i < 64; i++) {
+		r.ox[i] = (scalar)(i % 8 * 4); r.oy[i] = (scalar)(i / 8 * 4) + (scalar)0.5; r.oz[i] = 10;
+		r.dx[i] = 0; r.dy[i] = 0; r.dz[i] = -1;
+	}
+	raysInit(&r, 64);
+	compareBvh("grid", verts, GRID * GRID * 2, &r, 64);
+
+	//the SAH traversal cost must leave some multi-triangle leaves
+	static bvhNode nodes[2 * GRID * GRID * 2];
+	static int indices[GRID * GRID * 2];
+	bvh tree;
+	bvhBuild(&tree, nodes, indices, verts, GRID * GRID * 2);
+	int maxLeaf = 0;
+	for (int i = 0; i < tree.nodeCount; i++) {
+		maxLeaf = nodes[i].count > maxLeaf ? nodes[i].count : maxLeaf;
+	}
+	if (tree.nodeCount >= 2 * GRID * GRID * 2 - 1 || maxLeaf < 2 || maxLeaf > MMATH_BVH_MAX_LEAF) {
+		printf("FAIL grid leaves: %d nodes, largest leaf %d\n", tree.nodeCount, maxLeaf);
+		failures++;
+	}
+}
+
+static void testAABB(void) {
+	static rays r;
+	aabb box = { {{{0, 0, 0}}}, {{{1, 1, 1}}} };
+	static scalar t[RAYS];
+	static int hit[RAYS];
+	t[0] = t[1] = 1000;
+	//one ray lies on the x = 0 face, one passes through the middle
+	r.ox[0] = 0; r.oy[0] = (scalar)0.5; r.oz[0] = -5;
+	r.ox[1] = (scalar)0.5; r.oy[1] = (scalar)0.5; r.oz[1] = -5;
+	for (int i = 0; i < 2; i++) {
+		r.dx[i] = 0; r.dy[i] = 0; r.dz[i] = 1;
+	}
+	raysInit(&r, 2);
+	if (rayBatchAABBs(t, hit, &r.batch, &box, 1) != 2 || mm_abs(t[0] - 5) > TOLERANCE || mm_abs(t[1] - 5) > TOLERANCE) {
+		fail("aabb face", 0);
+	}
+}
+
+static void testSpheres(void) {
+	static rays r;
+	static scalar t[RAYS];
+	static int hit[RAYS];
+	sphere s[20];
+	for (int i = 0; i < 20; i++) {
+		vec3 c = {{{rnd() * 5, rnd() * 5, rnd() * 5}}};
+		s[i].center = c;
+		s[i].radius = mm_abs(rnd());
+	}
+	for (int i = 0; i < RAYS; i++) {
+		r.ox[i] = rnd() * 5; r.oy[i] = rnd() * 5; r.oz[i] = -10;
+		r.dx[i] = rnd() * (scalar)0.3; r.dy[i] = rnd() * (scalar)0.3; r.dz[i] = 1;
+		t[i] = 1000;
+	}
+	raysInit(&r, RAYS);
+	rayBatchSpheres(t, hit, &r.batch, s, 20);
+	for (int i = 0; i < RAYS; i++) {
+		vec3 o = {{{r.ox[i], r.oy[i], r.oz[i]}}}, d = {{{r.dx[i], r.dy[i], r.dz[i]}}};
+		scalar best = 1000;
+		int bestHit = -1;
+		for (int j = 0; j < 20; j++) {
+			vec3 oc;
+			vec3Sub(&oc, &o, &s[j].center);
+			scalar a = vec3Dot(&d, &d), b = vec3Dot(&oc, &d);
+			scalar disc = b * b - a * (vec3Dot(&oc, &oc) - s[j].radius * s[j].radius);
+			if (disc < 0) {
+				continue;
+			}
+			scalar tn = (-b - mm_sqrt(disc)) / a;
+			if (tn <= MMATH_RAY_EPSILON) {
+				tn = (-b + mm_sqrt(disc)) / a;
+			}
+			if (tn > MMATH_RAY_EPSILON && tn < best) {
+				best = tn;
+				bestHit = j;
+			}
+		}
+		if (hit[i] != bestHit || mm_abs(t[i] - best) > TOLERANCE) {
+			fail("spheres", i);
+			return;
+		}
+	}
+}
+
+int main(void) {
+	srand(1);
+	testSoup();
+	testEmpty();
+	testGrid();
+	testAABB();
+	testSpheres();
+	printf("bvh (packet width %d): %s\n", MMATH_PACKET_WIDTH, failures ? "FAILED" : "passed");
+	return failures != 0;
+}
@@ -0,0 +1,212 @@
+/* double_avx.c -- checks MMATH_DOUBLE math against reference formulas
+ *
+ * Built once with MMATH_NO_SIMD and once with AVX2 + FMA (see Makefile),
+ * so both paths are held to the same results within TOLERANCE.
+ */
+
+#define MMATH_DOUBLE
+#include "../MMath.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TOLERANCE 1e-12
+#define COUNT 64
+
+static int failures = 0;
+
+static void check(const char *name, const scalar *got, const scalar *expect, int n) {
+	for (int i = 0; i < n; i++) {
+		if (!(fabs(got[i] - expect[i]) <= TOLERANCE)) {
+			printf("FAIL %s[%d]: %.17g != %.17g\n", name, i, got[i], expect[i]);
+			failures++;
+			return;
+		}
+	}
+}
+static scalar rnd(void) {
+	return (scalar)rand() / RAND_MAX * 2 - 1;
+}
+
+//reference formulas, written out element by element
+static void refMat4Mul(mat4 *dest, const mat4 *a, const mat4 *b) {
+	for (int x = 0; x < 4; x++) {
+		for (int y = 0; y < 4; y++) {
+			scalar sum = 0;
+			for (int i = 0; i < 4; i++) {
+				sum += a->row[x].data[i] * b->row[i].data[y];
+			}
+			dest->row[x].data[y] = sum;
+		}
+	}
+}
+static void refMat4MulVec4(vec4 *dest, const mat4 *a, const vec4 *b) {
+	for (int i = 0; i < 4; i++) {
+		dest->data[i] = a->r0.data[i] * b->x + a->r1.data[i] * b->y + a->r2.data[i] * b->z + a->r3.data[i] * b->w;
+	}
+}
+static void refQuatMul(quat *dest, const quat *a, const quat *b) {
+	dest->x = a->w * b->x + a->x * b->w + a->y * b->z - a->z * b->y;
+	dest->y = a->w * b->y - a->x * b->z + a->y * b->w + a->z * b->x;
+	dest->z = a->w * b->z + a->x * b->y - a->y * b->x + a->z * b->w;
+	dest->w = a->w * b->w - a->x * b->x - a->y * b->y - a->z * b->z;
+}
+static void refTransformToMat4(mat4 *dest, const transform *t) {
+	mat3 r;
+	quatToMat3(&r, &t->rot);
+	for (int x = 0; x < 3; x++) {
+		for (int y = 0; y < 3; y++) {
+			dest->row[x].data[y] = r.row[x].data[y] * t->scale.data[y];
+		}
+		dest->row[x].w = 0;
+	}
+	dest->r3.x = t->pos.x;
+	dest->r3.y = t->pos.y;
+	dest->r3.z = t->pos.z;
+	dest->r3.w = 1;
+}
+
+static void testVec4(void) {
+	for (int k = 0; k < COUNT; k++) {
+		vec4 a = {{{rnd(), rnd(), rnd(), rnd()}}}, b = {{{rnd(), rnd(), rnd(), rnd()}}};
+		scalar s = rnd() + 2;
+		vec4 got, expect;
+		for (int i = 0; i < 4; i++) expect.data[i] = a.data[i] + b.data[i];
+		check("vec4Add", vec4Add(&got, &a, &b)->data, expect.data, 4);
+		for (int i = 0; i < 4; i++) expect.data[i] = a.data[i] - b.data[i];
+		check("vec4Sub", vec4Sub(&got, &a, &b)->data, expect.data, 4);
+		for (int i = 0; i < 4; i++) expect.data[i] = a.data[i] * b.data[i];
+		check("vec4Mul", vec4Mul(&got, &a, &b)->data, expect.data, 4);
+		for (int i = 0; i < 4; i++) expect.data[i] = a.data[i] / s;
+		check("vec4DivScalar", vec4DivScalar(&got, &a, s)->data, expect.data, 4);
+		for (int i = 0; i < 4; i++) expect.data[i] = a.data[i] * s;
+		check("vec4MulScalar", vec4MulScalar(&got, &a, s)->data, expect.data, 4);
+		for (int i = 0; i < 4; i++) expect.data[i] = a.data[i] + s;
+		check("vec4AddScalar", vec4AddScalar(&got, &a, s)->data, expect.data, 4);
+		for (int i = 0; i < 4; i++) expect.data[i] = -a.data[i];
+		check("vec4Negate", vec4Negate(&got, &a)->data, expect.data, 4);
+		for (int i = 0; i < 4; i++) expect.data[i] = fabs(a.data[i]);
+		check("vec4Abs", vec4Abs(&got, &a)->data, expect.data, 4);
+
+		scalar dot = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+		scalar gotDot = vec4Dot(&a, &b);
+		check("vec4Dot", &gotDot, &dot, 1);
+		scalar len = sqrt(a.x * a.x + a.y * a.y + a.z * a.z + a.w * a.w);
+		scalar gotLen = vec4Length(&a);
+		check("vec4Length", &gotLen, &len, 1);
+		for (int i = 0; i < 4; i++) expect.data[i] = a.data[i] / len;
+		check("vec4Normalize", vec4Normalize(&got, &a)->data, expect.data, 4);
+		for (int i = 0; i < 4; i++) expect.data[i] = a.data[i] + (b.data[i] - a.data[i]) * 0.25;
+		check("vec4Lerp", vec4Lerp(&got, &a, &b, 0.25)->data, expect.data, 4);
+
+		//dest aliasing an input
+		for (int i = 0; i < 4; i++) expect.data[i] = a.data[i] + b.data[i];
+		got = a;
+		check("vec4Add alias", vec4Add(&got, &got, &b)->data, expect.data, 4);
+	}
+}
+
+static void testMat4(void) {
+	static mat4 a[COUNT], b[COUNT], got[COUNT], expect[COUNT];
+	static vec4 v[COUNT], gotVec[COUNT], expectVec[COUNT];
+	for (int k = 0; k < COUNT; k++) {
+		for (int i = 0; i < 16; i++) {
+			a[k].data[i] = rnd();
+			b[k].data[i] = rnd();
+		}
+		for (int i = 0; i < 4; i++) {
+			v[k].data[i] = rnd();
+		}
+	}
+
+	for (int k = 0; k < COUNT; k++) {
+		refMat4Mul(&expect[k], &a[k], &b[k]);
+		check("mat4Mul", mat4Mul(&got[k], &a[k], &b[k])->data, expect[k].data, 16);
+		mat4 alias = a[k];
+		check("mat4Mul alias a", mat4Mul(&alias, &alias, &b[k])->data, expect[k].data, 16);
+		alias = b[k];
+		check("mat4Mul alias b", mat4Mul(&alias, &a[k], &alias)->data, expect[k].data, 16);
+
+		refMat4MulVec4(&expectVec[k], &a[k], &v[k]);
+		check("mat4MulVec4", mat4MulVec4(&gotVec[k], &a[k], &v[k])->data, expectVec[k].data, 4);
+		vec4 aliasVec = v[k];
+		check("mat4MulVec4 alias", mat4MulVec4(&aliasVec, &a[k], &aliasVec)->data, expectVec[k].data, 4);
+
+		mat4 t;
+		for (int x = 0; x < 4; x++) {
+			for (int y = 0; y < 4; y++) {
+				t.row[x].data[y] = a[k].row[y].data[x];
+			}
+		}
+		check("mat4Transpose", mat4Transpose(&got[k], &a[k])->data, t.data, 16);
+		alias = a[k];
+		check("mat4Transpose alias", mat4Transpose(&alias, &alias)->data, t.data, 16);
+
+		for (int i = 0; i < 16; i++) t.data[i] = a[k].data[i] + b[k].data[i];
+		check("mat4Add", mat4Add(&got[k], &a[k], &b[k])->data, t.data, 16);
+		for (int i = 0; i < 16; i++) t.data[i] = a[k].data[i] - b[k].data[i];
+		check("mat4Sub", mat4Sub(&got[k], &a[k], &b[k])->data, t.data, 16);
+		for (int i = 0; i < 16; i++) t.data[i] = a[k].data[i] * 3;
+		check("mat4MulScalar", mat4MulScalar(&got[k], &a[k], 3)->data, t.data, 16);
+	}
+
+	for (int k = 0; k < COUNT; k++) {
+		refMat4Mul(&expect[k], &a[k], &b[k]);
+		refMat4MulVec4(&expectVec[k], &a[0], &v[k]);
+	}
+	mat4MulBatch(got, a, b, COUNT);
+	check("mat4MulBatch", got[0].data, expect[0].data, 16 * COUNT);
+	mat4MulVec4Batch(gotVec, &a[0], v, COUNT);
+	check("mat4MulVec4Batch", gotVec[0].data, expectVec[0].data, 4 * COUNT);
+}
+
+static void testQuatTransform(void) {
+	static quat a[COUNT], b[COUNT], got[COUNT], expect[COUNT];
+	static transform t[COUNT], u[COUNT], gotT[COUNT];
+	static mat4 gotM[COUNT], expectM[COUNT];
+	for (int k = 0; k < COUNT; k++) {
+		quat qa = {{{rnd(), rnd(), rnd(), rnd()}}}, qb = {{{rnd(), rnd(), rnd(), rnd()}}};
+		quatNormalize(&a[k], &qa);
+		quatNormalize(&b[k], &qb);
+		refQuatMul(&expect[k], &a[k], &b[k]);
+		check("quatMul", quatMul(&got[k], &a[k], &b[k])->data, expect[k].data, 4);
+		quat alias = a[k];
+		check("quatMul alias", quatMul(&alias, &alias, &b[k])->data, expect[k].data, 4);
+
+		t[k].pos = (vec3){{{rnd(), rnd(), rnd()}}};
+		t[k].scale = (vec3){{{rnd() + 2, rnd() + 2, rnd() - 2}}};
+		t[k].rot = a[k];
+		u[k].pos = (vec3){{{rnd(), rnd(), rnd()}}};
+		u[k].scale = (vec3){{{rnd() + 2, rnd() + 2, rnd() + 2}}};
+		u[k].rot = b[k];
+		refTransformToMat4(&expectM[k], &t[k]);
+		check("transformToMat4", transformToMat4(&gotM[k], &t[k])->data, expectM[k].data, 16);
+	}
+
+	quatMulBatch(got, a, b, COUNT);
+	check("quatMulBatch", got[0].data, expect[0].data, 4 * COUNT);
+	transformToMat4Batch(gotM, t, COUNT);
+	check("transformToMat4Batch", gotM[0].data, expectM[0].data, 16 * COUNT);
+
+	transformMulBatch(gotT, t, u, COUNT);
+	for (int k = 0; k < COUNT; k++) {
+		transform e;
+		vec3 p;
+		quatMulVec3(&p, &t[k].rot, &u[k].pos);
+		for (int i = 0; i < 3; i++) {
+			e.pos.data[i] = p.data[i] * t[k].scale.data[i] + t[k].pos.data[i];
+			e.scale.data[i] = t[k].scale.data[i] * u[k].scale.data[i];
+		}
+		refQuatMul(&e.rot, &t[k].rot, &u[k].rot);
+		check("transformMulBatch", gotT[k].pos.data, e.pos.data, 10);
+	}
+}
+
+int main(void) {
+	srand(1);
+	testVec4();
+	testMat4();
+	testQuatTransform();
+	printf("%s (packet width %d): %s\n", MMATH_PACKET_WIDTH > 1 ? "simd" : "scalar", MMATH_PACKET_WIDTH,
+	       failures ? "FAILED" : "passed");
+	return failures != 0;
+}
@@ -0,0 +1,98 @@
+/* vertex.c -- checks vertexTransformBatch against mat4MulVec4 and an explicit normal matrix
+ *
+ * Built scalar and SIMD, in float and double precision (see Makefile).
+ * Positions are compared relative to their magnitude.
+ */
+
+#include "../MMath.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(MMATH_DOUBLE)
+#define TOLERANCE 1e-12
+#else
+#define TOLERANCE 1e-5f
+#endif
+#define COUNT 1003
+
+static int failures = 0;
+
+static scalar rnd(void) {
+	return (scalar)rand() / RAND_MAX * 2 - 1;
+}
+static void check(const char *name, int i, const vec3 *got, const vec3 *expect) {
+	VEC_FOR(3) {
+		if (!(mm_abs(got->data[i] - expect->data[i]) <= TOLERANCE * mm_max(1, mm_abs(expect->data[i])))) {
+			printf("FAIL %s[%d]: (%g %g %g) != (%g %g %g)\n", name, i,
+			       (double)got->x, (double)got->y, (double)got->z, (double)expect->x, (double)expect->y, (double)expect->z);
+			failures++;
+			return;
+		}
+	}
+}
+
+static void testMatrix(const char *name, const transform *t) {
+	static vertex src[COUNT], dest[COUNT];
+	mat4 m;
+	transformToMat4(&m, t);
+	for (int i = 0; i < COUNT; i++) {
+		vec3 p = {{{rnd(), rnd(), rnd()}}}, n = {{{rnd(), rnd(), rnd()}}};
+		vec4 tan = {{{rnd(), rnd(), rnd(), i % 2 ? 1 : -1}}};
+		src[i].pos = p;
+		vec3Normalize(&src[i].normal, &n);
+		src[i].tangent = tan;
+	}
+	src[7].normal = vec3Zero;
+	vertexTransformBatch(dest, src, &m, COUNT);
+
+	//reference: inverse transpose of the upper 3x3
+	mat3 upper, inv, normal;
+	mat4ToMat3(&upper, &m);
+	mat3Inverse(&inv, &upper);
+	mat3Transpose(&normal, &inv);
+	scalar hand = mat3Determinant(&upper) < 0 ? -1 : 1;
+	for (int i = 0; i < COUNT; i++) {
+		vec4 p, pp;
+		vec3 pos, n, expectN = vec3Zero, tan, tt, expectT = vec3Zero, gotT;
+		mat4MulVec4(&pp, &m, vec3ToVec4(&p, &src[i].pos, 1));
+		check(name, i, &dest[i].pos, vec4ToVec3(&pos, &pp));
+		vec3Normalize(&expectN, mat3MulVec3(&n, &normal, &src[i].normal));
+		check(name, i, &dest[i].normal, &expectN);
+		vec3Normalize(&expectT, mat3MulVec3(&tt, &upper, vec4ToVec3(&tan, &src[i].tangent)));
+		check(name, i, vec4ToVec3(&gotT, &dest[i].tangent), &expectT);
+		if (dest[i].tangent.w != src[i].tangent.w * hand) {
+			printf("FAIL %s[%d]: handedness\n", name, i);
+			failures++;
+			return;
+		}
+	}
+}
+
+int main(void) {
+	srand(1);
+	transform t = { {{{1, 2, 3}}}, {{{1.5f, 0.5f, 2}}}, {{{0.2f, 0.3f, 0.1f, 0.9f}}} };
+	quatNormalize(&t.rot, &t.rot);
+	testMatrix("non uniform", &t);
+
+	t.scale = (vec3){{{2, 2, 2}}};
+	testMatrix("uniform", &t);
+
+	t.scale = (vec3){{{-1.5f, 0.5f, 2}}};
+	testMatrix("mirrored", &t);
+
+	t.scale = (vec3){{{-2, -2, -2}}};
+	testMatrix("uniform mirrored", &t);
+
+#if defined(MMATH_DOUBLE)
+	//scales whose squared lengths are outside float range
+	t.scale = (vec3){{{1e-21, 2e-21, 1e-21}}};
+	t.pos = vec3Zero;
+	testMatrix("tiny scale", &t);
+	t.scale = (vec3){{{1e21, 2e21, 1e21}}};
+	testMatrix("huge scale", &t);
+#endif
+
+	printf("vertex (%s, packet width %d): %s\n", sizeof(scalar) == 8 ? "double" : "float", MMATH_PACKET_WIDTH,
+	       failures ? "FAILED" : "passed");
+	return failures != 0;
+}